@@ -1,14 +1,608 @@
 #include <json-parser/json-parser.h>
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PROFILE_HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_HAS_RDTSC 1
+#endif
+
+struct Measurement
+{
+	double seconds;
+	double cycles;
+};
+
+template<typename F>
+Measurement
+measure(F&& f)
+{
+	auto start = std::chrono::steady_clock::now();
+#if PROFILE_HAS_RDTSC
+	auto start_cycles = __rdtsc();
+#endif
+
+	f();
+
+#if PROFILE_HAS_RDTSC
+	double cycles = double(__rdtsc() - start_cycles);
+#else
+	double cycles = 0;
+#endif
+	std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+	return {seconds.count(), cycles};
+}
+
+void
+report(const char* name, size_t bytes, Measurement m, size_t allocations)
+{
+	::printf("%-24s %10zu bytes %8.2f ms %10.1f MB/s", name, bytes, m.seconds * 1e3, bytes / m.seconds / 1e6);
+	if (m.cycles > 0)
+		::printf(" %8.3f bytes/cycle", bytes / m.cycles);
+	::printf(" %10zu allocations\n", allocations);
+}
+
+// Best of `runs`, the first parse also warms up the caches
+bool
+profile_parse(const char* name, const std::string& content, int runs, J_Parse_Options options = {})
+{
+	Measurement best{1e30, 1e30};
+	size_t allocations = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		J_Parse_Result result{};
+		size_t allocations_before = j_allocation_count();
+		auto m = measure([&] { result = j_parse_with_options(content.c_str(), content.size(), options); });
+		if (result.err)
+		{
+			::printf("%s: %s\n", name, result.err);
+			return false;
+		}
+		allocations = j_allocation_count() - allocations_before;
+		j_free(result.json);
+
+		best.seconds = std::min(best.seconds, m.seconds);
+		best.cycles = std::min(best.cycles, m.cycles);
+	}
+	report(name, content.size(), best, allocations);
+	return true;
+}
+
+// Counts every value through j_parse_sax, no document is built, best of `runs`
+bool
+profile_sax(const std::string& content, int runs)
+{
+	J_Sax_Callbacks callbacks{};
+	callbacks.on_null = [](void* user) { ++*(size_t*)user; return true; };
+	callbacks.on_bool = [](void* user, J_Bool) { ++*(size_t*)user; return true; };
+	callbacks.on_number = [](void* user, J_Number, const char*, size_t) { ++*(size_t*)user; return true; };
+	callbacks.on_string = [](void* user, const char*, size_t) { ++*(size_t*)user; return true; };
+	callbacks.on_begin_object = [](void* user) { ++*(size_t*)user; return true; };
+	callbacks.on_begin_array = [](void* user) { ++*(size_t*)user; return true; };
+
+	Measurement best{1e30, 1e30};
+	size_t allocations = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		size_t count = 0;
+		const char* err = nullptr;
+		size_t allocations_before = j_allocation_count();
+		auto m = measure([&] { err = j_parse_sax(content.c_str(), content.size(), &callbacks, &count); });
+		if (err)
+		{
+			::printf("j_parse_sax: %s\n", err);
+			return false;
+		}
+		allocations = j_allocation_count() - allocations_before;
+
+		best.seconds = std::min(best.seconds, m.seconds);
+		best.cycles = std::min(best.cycles, m.cycles);
+	}
+	report("j_parse_sax (counting)", content.size(), best, allocations);
+	return true;
+}
+
+// The input fed to a J_Parser in `chunk_size` pieces, best of `runs`
+bool
+profile_push(const char* name, const std::string& content, int runs, size_t chunk_size)
+{
+	Measurement best{1e30, 1e30};
+	size_t allocations = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		J_Parse_Result result{};
+		size_t allocations_before = j_allocation_count();
+		auto m = measure([&] {
+			J_Parser* parser = j_parser_new(J_Parse_Options{});
+			for (size_t offset = 0; offset < content.size(); offset += chunk_size)
+				if (j_parser_feed(parser, content.data() + offset, std::min(chunk_size, content.size() - offset)))
+					break;
+			result = j_parser_finish(parser);
+		});
+		if (result.err)
+		{
+			::printf("%s: %s\n", name, result.err);
+			return false;
+		}
+		allocations = j_allocation_count() - allocations_before;
+		j_free(result.json);
+
+		best.seconds = std::min(best.seconds, m.seconds);
+		best.cycles = std::min(best.cycles, m.cycles);
+	}
+	report(name, content.size(), best, allocations);
+	return true;
+}
+
+// Teardown of malloc'd nodes against a J_Document arena, best of `runs`
+bool
+profile_document(const std::string& content, int runs)
+{
+	Measurement best_parse{1e30, 1e30}, best_free{1e30, 1e30}, best_document_free{1e30, 1e30};
+	size_t allocations = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		J_Parse_Result result = j_parse_with_options(content.c_str(), content.size(), {});
+		if (result.err)
+			return false;
+		auto m_free = measure([&] { j_free(result.json); });
+
+		J_Document_Result document{};
+		size_t allocations_before = j_allocation_count();
+		auto m_parse = measure([&] { document = j_parse_document(content.c_str(), content.size(), {}); });
+		if (document.err)
+		{
+			::printf("j_parse_document: %s\n", document.err);
+			return false;
+		}
+		allocations = j_allocation_count() - allocations_before;
+		auto m_document_free = measure([&] { j_document_free(document.document); });
+
+		for (auto [best, m]: {std::pair{&best_parse, m_parse}, std::pair{&best_free, m_free}, std::pair{&best_document_free, m_document_free}})
+		{
+			best->seconds = std::min(best->seconds, m.seconds);
+			best->cycles = std::min(best->cycles, m.cycles);
+		}
+	}
+	report("j_parse_document", content.size(), best_parse, allocations);
+	report("j_free", content.size(), best_free, 0);
+	report("j_document_free", content.size(), best_document_free, 0);
+	return true;
+}
+
+double
+sum_numbers(J_JSON json)
+{
+	switch (json.kind)
+	{
+	case J_JSON_NUMBER:
+		return json.as_number;
+
+	case J_JSON_ARRAY: {
+		double sum = 0;
+		for (size_t i = 0; i < json.as_array.count; i++)
+			sum += sum_numbers(json.as_array.ptr[i]);
+		return sum;
+	}
+
+	case J_JSON_OBJECT: {
+		double sum = 0;
+		for (size_t i = 0; i < json.as_object.count; i++)
+			sum += sum_numbers(json.as_object.pairs[i].value);
+		return sum;
+	}
+
+	default:
+		return 0;
+	}
+}
+
+double
+sum_numbers(J_Tape_Value value)
+{
+	switch (j_tape_kind(value))
+	{
+	case J_JSON_NUMBER:
+		return j_tape_get_number(value);
+
+	case J_JSON_ARRAY:
+	case J_JSON_OBJECT: {
+		double sum = 0;
+		J_Tape_Iterator it = j_tape_iterate(value);
+		while (j_tape_next(&it))
+			sum += sum_numbers(it.value);
+		return sum;
+	}
+
+	default:
+		return 0;
+	}
+}
+
+// Parse and a full traversal of the tape against the tree, best of `runs`
+bool
+profile_tape(const std::string& content, int runs)
+{
+	Measurement best_parse{1e30, 1e30}, best_tree_walk{1e30, 1e30}, best_tape_walk{1e30, 1e30};
+	size_t allocations = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		J_Tape_Result tape{};
+		size_t allocations_before = j_allocation_count();
+		auto m_parse = measure([&] { tape = j_parse_tape(content.c_str(), content.size(), {}); });
+		if (tape.err)
+		{
+			::printf("j_parse_tape: %s\n", tape.err);
+			return false;
+		}
+		allocations = j_allocation_count() - allocations_before;
+
+		J_Parse_Result tree = j_parse_with_options(content.c_str(), content.size(), {});
+		double tree_sum = 0, tape_sum = 0;
+		auto m_tree_walk = measure([&] { tree_sum = sum_numbers(tree.json); });
+		auto m_tape_walk = measure([&] { tape_sum = sum_numbers(j_tape_root(tape.tape)); });
+		if (tree_sum != tape_sum)
+		{
+			::printf("j_parse_tape: traversals disagree\n");
+			return false;
+		}
+		j_free(tree.json);
+		j_tape_free(tape.tape);
+
+		for (auto [best, m]: {std::pair{&best_parse, m_parse}, std::pair{&best_tree_walk, m_tree_walk}, std::pair{&best_tape_walk, m_tape_walk}})
+		{
+			best->seconds = std::min(best->seconds, m.seconds);
+			best->cycles = std::min(best->cycles, m.cycles);
+		}
+	}
+	report("j_parse_tape", content.size(), best_parse, allocations);
+	report("walk (tree)", content.size(), best_tree_walk, 0);
+	report("walk (tape)", content.size(), best_tape_walk, 0);
+	return true;
+}
+
+// Lookups of every key of a config-like object with `count` keys, by a strcmp scan and j_object_get
+bool
+profile_object_get(size_t count)
+{
+	std::string input = "{";
+	for (size_t i = 0; i < count; i++)
+		input += "\"setting." + std::to_string(i) + "\": " + std::to_string(i) + ", ";
+	input += "\"\": 0}";
+
+	J_Document_Result result = j_parse_document(input.data(), input.size(), J_Parse_Options{});
+	if (result.err)
+	{
+		::printf("j_parse_document: %s\n", result.err);
+		return false;
+	}
+
+	std::vector<std::string> keys;
+	for (size_t i = 0; i < count; i++)
+		keys.push_back("setting." + std::to_string(i * 7919 % count));
+
+	J_Object object = result.json.as_object;
+	double sum = 0;
+	auto scan = measure([&] {
+		for (const auto& key: keys)
+			for (size_t i = 0; i < object.count; i++)
+				if (::strcmp(object.pairs[i].key, key.c_str()) == 0)
+				{
+					sum += object.pairs[i].value.as_number;
+					break;
+				}
+	});
+	auto get = measure([&] {
+		for (const auto& key: keys)
+			sum += j_object_get(object, key.data(), key.size())->as_number;
+	});
+	report("lookups (strcmp scan)", input.size(), scan, 0);
+	report("lookups (j_object_get)", input.size(), get, 0);
+
+	j_document_free(result.document);
+	return sum > 0;
+}
+
+// Walks `pointer` the way callers did before j_pointer_compile: split, unescape and strcmp each time
+J_JSON*
+walk_pointer(J_JSON* json, const char* pointer)
+{
+	std::string token;
+	while (json && *pointer == '/')
+	{
+		token.clear();
+		for (pointer++; *pointer && *pointer != '/'; pointer++)
+		{
+			if (*pointer == '~')
+				token += *++pointer == '0' ? '~' : '/';
+			else
+				token += *pointer;
+		}
+
+		J_JSON* next = nullptr;
+		if (json->kind == J_JSON_OBJECT)
+		{
+			for (size_t i = 0; i < json->as_object.count; i++)
+				if (token == json->as_object.pairs[i].key)
+					next = &json->as_object.pairs[i].value;
+		}
+		else if (json->kind == J_JSON_ARRAY)
+		{
+			size_t index = ::strtoull(token.c_str(), nullptr, 10);
+			if (index < json->as_array.count)
+				next = &json->as_array.ptr[index];
+		}
+		json = next;
+	}
+	return json;
+}
+
+// The same `count` pointers evaluated against `documents` records
+bool
+profile_pointer(size_t count, size_t documents)
+{
+	std::string input = R"({"users": [)";
+	for (size_t i = 0; i < 100; i++)
+	{
+		input += i ? ", " : "";
+		input += R"({"id": )" + std::to_string(i) + R"(, "profile": {)";
+		for (size_t j = 0; j < 30; j++)
+			input += (j ? ", " : "") + std::string("\"field") + std::to_string(j) + "\": " + std::to_string(i * j + 1);
+		input += "}}";
+	}
+	input += "]}";
+
+	J_Parse_Result result = j_parse(input.c_str());
+	if (result.err)
+	{
+		::printf("j_parse: %s\n", result.err);
+		return false;
+	}
+
+	std::vector<std::string> pointers;
+	std::vector<J_Pointer*> compiled;
+	for (size_t i = 0; i < count; i++)
+	{
+		pointers.push_back("/users/" + std::to_string(i * 37 % 100) + "/profile/field" + std::to_string(i % 30));
+		compiled.push_back(j_pointer_compile(pointers.back().data(), pointers.back().size()).pointer);
+	}
+
+	double sum = 0;
+	auto walk = measure([&] {
+		for (size_t d = 0; d < documents; d++)
+			for (const auto& pointer: pointers)
+				sum += walk_pointer(&result.json, pointer.c_str())->as_number;
+	});
+	auto eval = measure([&] {
+		for (size_t d = 0; d < documents; d++)
+			for (J_Pointer* pointer: compiled)
+				sum += j_pointer_eval(&result.json, pointer)->as_number;
+	});
+	report("pointers (walk)", input.size() * documents, walk, 0);
+	report("pointers (compiled)", input.size() * documents, eval, 0);
+
+	for (J_Pointer* pointer: compiled)
+		j_pointer_free(pointer);
+	j_free(result.json);
+	return sum > 0;
+}
+
+// An API response of `count` records, each with a few fields worth querying and bulk that isn't
+std::string
+generate_api_response(size_t count)
+{
+	std::string input = R"({"meta": {"page": 1}, "data": [)";
+	for (size_t i = 0; i < count; i++)
+	{
+		input += i ? ", " : "";
+		input += R"({"id": )" + std::to_string(i) + R"(, "status": ")" + (i % 3 ? "active" : "closed") + R"(", "attributes": {)";
+		for (size_t j = 0; j < 20; j++)
+			input += (j ? ", " : "") + std::string("\"attribute") + std::to_string(j) + "\": \"value " + std::to_string(i * j) + "\"";
+		input += R"(}, "history": [)";
+		for (size_t j = 0; j < 10; j++)
+			input += (j ? ", " : "") + std::string(R"({"at": 1700000000, "event": "updated", "by": [1, 2, 3]})");
+		input += "]}";
+	}
+	input += "]}";
+	return input;
+}
+
+// Querying while lexing against parsing everything and walking the tree
+bool
+profile_query(size_t count)
+{
+	std::string input = generate_api_response(count);
+	double sum = 0;
+
+	auto walk = measure([&] {
+		J_Parse_Result result = j_parse_with_options(input.data(), input.size(), J_Parse_Options{});
+		J_Object root = result.json.as_object;
+		for (size_t i = 0; i < root.count; i++)
+		{
+			if (::strcmp(root.pairs[i].key, "data") != 0)
+				continue;
+			J_Array data = root.pairs[i].value.as_array;
+			for (size_t j = 0; j < data.count; j++)
+			{
+				J_Object record = data.ptr[j].as_object;
+				if (::strcmp(record.pairs[1].value.as_string, "active") == 0)
+					sum += record.pairs[0].value.as_number;
+			}
+		}
+		j_free(result.json);
+	});
+
+	const char* path = "$.data[?(@.status == 'active')].id";
+	J_Query* query = j_query_compile(path, ::strlen(path)).query;
+	J_Query_Result result{};
+	auto run = measure([&] {
+		result = j_query(input.data(), input.size(), query, J_Parse_Options{});
+		for (size_t i = 0; i < result.count; i++)
+			sum += result.values[i].as_number;
+		j_document_free(result.document);
+	});
+	j_query_free(query);
+	if (result.err)
+	{
+		::printf("j_query: %s\n", result.err);
+		return false;
+	}
+
+	report("j_parse, then walk", input.size(), walk, 0);
+	report("j_query", input.size(), run, 0);
+	return sum > 0;
+}
+
+// Log-like NDJSON records up to `size` bytes, the same every run
+std::string
+generate_ndjson(size_t size)
+{
+	static const char* LEVELS[] = {"debug", "info", "warn", "error"};
+
+	std::string ndjson;
+	ndjson.reserve(size + 512);
+	char record[512];
+	for (uint64_t i = 0; ndjson.size() < size; i++)
+	{
+		uint64_t x = i * 0x9E3779B97F4A7C15;
+		int n = ::snprintf(record, sizeof(record),
+			R"({"ts": %llu, "level": "%s", "msg": "request \"%llx\" done", "latency": %.3f, "ok": %s, "tags": ["svc-%u", "zone-%u"], "user": {"id": %u, "name": null}})" "\n",
+			(unsigned long long)(1700000000000 + i * 7), LEVELS[x >> 62], (unsigned long long)(x >> 16),
+			(double)(x % 100000) / 997.0, (x & 1) ? "true" : "false", unsigned(x >> 40) % 64, unsigned(x >> 32) % 8, unsigned(x % 1000003));
+		ndjson.append(record, n);
+	}
+	return ndjson;
+}
+
+// j_parse on one line at a time against j_parse_many at rising thread counts, one run each
+bool
+profile_ndjson(size_t size)
+{
+	std::string ndjson = generate_ndjson(size);
+
+	size_t records = 0;
+	size_t allocations_before = j_allocation_count();
+	auto m = measure([&] {
+		for (size_t begin = 0; begin < ndjson.size();)
+		{
+			size_t end = ndjson.find('\n', begin);
+			J_Parse_Result result = j_parse_with_options(ndjson.data() + begin, end - begin, J_Parse_Options{});
+			if (result.err == nullptr)
+				records++;
+			j_free(result.json);
+			begin = end + 1;
+		}
+	});
+	report("j_parse per line", ndjson.size(), m, j_allocation_count() - allocations_before);
+
+	auto count = [](void* user, size_t, J_Parse_Result result) {
+		if (result.err == nullptr)
+			++*(size_t*)user;
+		return true;
+	};
+
+	size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+	for (size_t threads = 1;; threads = std::min(threads * 2, cores))
+	{
+		size_t parsed = 0;
+		const char* err = nullptr;
+		auto m = measure([&] { err = j_parse_many(ndjson.data(), ndjson.size(), J_Parse_Options{}, threads, count, &parsed); });
+		if (err || parsed != records)
+		{
+			::printf("j_parse_many: %s, %zu of %zu records\n", err ? err : "ok", parsed, records);
+			return false;
+		}
+
+		char name[64];
+		::snprintf(name, sizeof(name), "j_parse_many (%zu threads)", threads);
+		report(name, ndjson.size(), m, 0); // workers count allocations on their own threads
+
+		if (threads == cores)
+			break;
+	}
+	return true;
+}
 
 int
 main(int argc, char const *argv[])
 {
-	std::ifstream ifs{PROFILE_CASE_PATH};
+	const char* path = argc > 1 ? argv[1] : PROFILE_CASE_PATH;
+	int runs = argc > 2 ? ::atoi(argv[2]) : 5;
+	size_t ndjson_mb = argc > 3 ? ::atoi(argv[3]) : 2048; // 0 skips the NDJSON benchmark
+
+	std::ifstream ifs{path, std::ios::binary};
 	std::string file_content{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
 
 	system("pause");
-	auto [json, err] = j_parse(file_content.c_str());
+
+	if (profile_parse("j_parse", file_content, runs) == false)
+		return 1;
+
+	if (profile_parse("j_parse (lazy numbers)", file_content, runs, J_Parse_Options{.lazy_numbers = true}) == false)
+		return 1;
+
+	if (profile_parse("j_parse (state machine)", file_content, runs, J_Parse_Options{.engine = J_PARSE_ENGINE_STATE_MACHINE}) == false)
+		return 1;
+
+	// Runs at least once with 2 threads, so that single-core machines show the cost of splitting
+	size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+	for (size_t threads = 2;; threads *= 2)
+	{
+		char name[64];
+		::snprintf(name, sizeof(name), "j_parse (%zu threads)", threads);
+		if (profile_parse(name, file_content, runs, J_Parse_Options{.threads = threads}) == false)
+			return 1;
+		if (threads >= cores)
+			break;
+	}
+
+	if (profile_sax(file_content, runs) == false)
+		return 1;
+
+	if (profile_push("j_parser_feed (4 KB)", file_content, runs, 4 << 10) == false)
+		return 1;
+
+	if (profile_push("j_parser_feed (64 KB)", file_content, runs, 64 << 10) == false)
+		return 1;
+
+	if (profile_document(file_content, runs) == false)
+		return 1;
+
+	if (profile_tape(file_content, runs) == false)
+		return 1;
+
+	// The same document without whitespace, compared to the input it shows what indentation costs
+	J_Parse_Result result = j_parse(file_content.c_str());
+	const char* dump = j_dump(result.json);
+	std::string minified = dump;
+	::free((void*)dump);
+	j_free(result.json);
+
+	if (profile_parse("j_parse (minified)", minified, runs) == false)
+		return 1;
+
+	if (profile_object_get(20000) == false)
+		return 1;
+
+	if (profile_pointer(300, 1000) == false)
+		return 1;
+
+	if (profile_query(100000) == false)
+		return 1;
+
+	if (ndjson_mb > 0 && profile_ndjson(ndjson_mb << 20) == false)
+		return 1;
 
 	return 0;
-}
\ No newline at end of file
+}
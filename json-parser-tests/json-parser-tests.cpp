@@ -3,8 +3,13 @@
 #include <doctest/doctest.h>
 #include <json-parser/json-parser.h>
 
+#include <cmath>
 #include <filesystem>
 #include <fstream>
+#include <string>
+#include <vector>
+
+#include <string.h>
 
 namespace J_JSON_Tests
 {
@@ -40,6 +45,18 @@ namespace J_JSON_Tests
 					CAPTURE(file_content.c_str());
 					CHECK_FALSE(!err);
 				}
+
+				auto [tokenized_json, tokenized_err] = j_parse_with_options(file_content.c_str(), file_content.size(), J_Parse_Options{.mode = J_PARSE_MODE_TOKENIZE});
+				CHECK(!err == !tokenized_err);
+
+				auto [lazy_json, lazy_err] = j_parse_with_options(file_content.c_str(), file_content.size(), J_Parse_Options{.lazy_numbers = true});
+				CHECK(!err == !lazy_err);
+
+				// The state machine engine against the table driven one
+				auto [machine_json, machine_err] = j_parse_with_options(file_content.c_str(), file_content.size(), J_Parse_Options{.engine = J_PARSE_ENGINE_STATE_MACHINE});
+				CHECK(!err == !machine_err);
+				if (!err && !machine_err)
+					CHECK(std::string{j_dump(json)} == std::string{j_dump(machine_json)});
 			}
 		}
 	}
@@ -95,6 +112,607 @@ TEST_SUITE("Must Reject")
 
 TEST_SUITE("Manual")
 {
+	TEST_CASE("Tokenize long strings")
+	{
+		// Longer than a compact token can describe, goes through the wide token extension
+		std::string input = "[\"" + std::string((1 << 24) + 5, 'x') + "\", 1]";
+
+		auto [json, err] = j_parse_with_options(input.c_str(), input.size(), J_Parse_Options{.mode = J_PARSE_MODE_TOKENIZE});
+		REQUIRE_MESSAGE(!err, err);
+		REQUIRE(json.as_array.count == 2);
+		CHECK(std::string{json.as_array.ptr[0].as_string} == std::string((1 << 24) + 5, 'x'));
+		CHECK(json.as_array.ptr[1].as_number == 1);
+		j_free(json);
+	}
+
+	TEST_CASE("Block boundaries")
+	{
+		// Backslash runs and quotes straddling the 64-byte blocks of the structural index
+		for (size_t pad = 0; pad < 70; pad++)
+		{
+			std::string padding(pad, ' ');
+			std::string input = padding + R"(["a\\\\", "\"]\\", 12345, true, {"k": null}])";
+
+			auto [json, err] = j_parse(input.c_str());
+			REQUIRE_MESSAGE(!err, err);
+			CHECK(std::string{j_dump(json)} == R"(["a\\\\","\"]\\",12345,true,{"k":null}])");
+			j_free(json);
+		}
+	}
+
+	TEST_CASE("Numbers")
+	{
+		// Expected values are compiler literals, which are correctly rounded
+		struct { const char* input; double expected; } cases[] = {
+			{"-0", -0.0},
+			{"9007199254740993", 9007199254740993.0},
+			{"18446744073709551615", 18446744073709551615.0},
+			{"123456789012345678901234567890", 123456789012345678901234567890.0},
+			{"0.1", 0.1},
+			{"-12.5e-3", -12.5e-3},
+			{"1E23", 1e23},
+			{"2.2250738585072011e-308", 2.2250738585072011e-308},
+			{"4.9406564584124654e-324", 4.9406564584124654e-324},
+			{"1.7976931348623157e308", 1.7976931348623157e308},
+			{"1.00000000000000011102230246251565404236316680908203125", 1.00000000000000011102230246251565404236316680908203125},
+			{"1.00000000000000011102230246251565404236316680908203126", 1.00000000000000011102230246251565404236316680908203126},
+			{"1e-400", 0.0},
+		};
+
+		for (auto [input, expected] : cases)
+		{
+			auto [json, err] = j_parse(input);
+			REQUIRE_MESSAGE(!err, err);
+			CHECK_MESSAGE(json.as_number == expected, input);
+			CHECK_MESSAGE(std::signbit(json.as_number) == std::signbit(expected), input);
+			j_free(json);
+		}
+	}
+
+	TEST_CASE("Lazy numbers")
+	{
+		const char* input = "[12345678901234567890, 9007199254740993, -1.5e3, 0.1, -9223372036854775808]";
+		auto [json, err] = j_parse_with_options(input, ::strlen(input), J_Parse_Options{.lazy_numbers = true});
+		REQUIRE_MESSAGE(!err, err);
+
+		J_JSON* numbers = json.as_array.ptr;
+		size_t count = 0;
+		const char* text = j_get_number_text(numbers[0], &count);
+		CHECK(std::string(text, count) == "12345678901234567890");
+
+		int64_t value = 0;
+		CHECK_FALSE(j_get_number_int64(numbers[0], &value));
+		CHECK(j_get_number_int64(numbers[1], &value));
+		CHECK(value == 9007199254740993);
+		CHECK(j_get_number_int64(numbers[2], &value));
+		CHECK(value == -1500);
+		CHECK_FALSE(j_get_number_int64(numbers[3], &value));
+		CHECK(j_get_number_int64(numbers[4], &value));
+		CHECK(value == INT64_MIN);
+
+		CHECK(j_get_J_Number(numbers[0]) == 12345678901234567890.0);
+		CHECK(j_get_J_Number(numbers[3]) == 0.1);
+
+		// Dumped as written
+		CHECK(std::string{j_dump(json)} == "[12345678901234567890,9007199254740993,-1.5e3,0.1,-9223372036854775808]");
+		j_free(json);
+	}
+
+	TEST_CASE("Max depth")
+	{
+		auto nested = [](size_t depth, char open, char close) {
+			std::string input;
+			for (size_t i = 0; i < depth; i++)
+				input += open == '{' ? std::string("{\"k\":") : std::string(1, open);
+			input += "0";
+			return input + std::string(depth, close);
+		};
+
+		for (J_PARSE_ENGINE engine: {J_PARSE_ENGINE_TABLE, J_PARSE_ENGINE_STATE_MACHINE})
+		{
+			for (auto [open, close]: {std::pair{'[', ']'}, std::pair{'{', '}'}})
+			{
+				std::string at_limit = nested(8, open, close);
+				auto [json, err] = j_parse_with_options(at_limit.c_str(), at_limit.size(), J_Parse_Options{.engine = engine, .max_depth = 8});
+				CHECK_MESSAGE(!err, err);
+				j_free(json);
+
+				std::string past_limit = nested(9, open, close);
+				auto [deep_json, deep_err] = j_parse_with_options(past_limit.c_str(), past_limit.size(), J_Parse_Options{.engine = engine, .max_depth = 8});
+				CHECK(std::string{deep_err ? deep_err : ""} == "Nesting too deep");
+			}
+
+			// Fails on the first container past the default limit, before the input runs out
+			std::string hostile(1 << 20, '[');
+			auto [json, err] = j_parse_with_options(hostile.c_str(), hostile.size(), J_Parse_Options{.engine = engine});
+			CHECK(std::string{err ? err : ""} == "Nesting too deep");
+		}
+	}
+
+	TEST_CASE("Allocations")
+	{
+		// One exactly sized block per container, the builder's scratch space is shared
+		std::string input = "[";
+		for (size_t i = 0; i < 1000; i++)
+			input += R"({"id": 1, "tags": [1, 2, 3]},)";
+		input.back() = ']';
+
+		size_t before = j_allocation_count();
+		auto [json, err] = j_parse(input.c_str());
+		size_t allocations = j_allocation_count() - before;
+		REQUIRE_MESSAGE(!err, err);
+		CHECK(allocations >= 2001);
+		CHECK(allocations < 2001 + 16);
+		j_free(json);
+	}
+
+	TEST_CASE("Document")
+	{
+		std::string input = R"({"a": [1, "two\n", {}, []], "b": ")" + std::string(1 << 20, 'x') + R"("})";
+
+		auto [json, err] = j_parse(input.c_str());
+		REQUIRE_MESSAGE(!err, err);
+
+		auto [document, document_json, document_err] = j_parse_document(input.c_str(), input.size(), J_Parse_Options{});
+		REQUIRE_MESSAGE(!document_err, document_err);
+		CHECK(std::string{j_dump(json)} == std::string{j_dump(document_json)});
+		CHECK(j_string_length(document_json.as_object.pairs[1].value.as_string) == 1 << 20);
+		j_document_free(document);
+		j_free(json);
+
+		auto [failed, failed_json, failed_err] = j_parse_document("[1, 2", 5, J_Parse_Options{});
+		CHECK(failed == nullptr);
+		CHECK_FALSE(!failed_err);
+	}
+
+	TEST_CASE("Tape")
+	{
+		const char* input = R"({"a": [1, [2, {"x": null}], "s"], "b": {}, "c": true, "d": -2.5})";
+		auto [tape, err] = j_parse_tape(input, ::strlen(input), J_Parse_Options{});
+		REQUIRE_MESSAGE(!err, err);
+
+		J_Tape_Value root = j_tape_root(tape);
+		REQUIRE(j_tape_kind(root) == J_JSON_OBJECT);
+		CHECK(j_tape_count(root) == 4);
+
+		std::string keys;
+		J_Tape_Iterator it = j_tape_iterate(root);
+		while (j_tape_next(&it))
+			keys += j_tape_get_string(it.key);
+		CHECK(keys == "abcd");
+
+		it = j_tape_iterate(root);
+		REQUIRE(j_tape_next(&it));
+		J_Tape_Value a = it.value;
+		REQUIRE(j_tape_kind(a) == J_JSON_ARRAY);
+		CHECK(j_tape_count(a) == 3);
+
+		// Skipping "a" lands on the key of the next pair
+		CHECK(std::string{j_tape_get_string(j_tape_skip(a))} == "b");
+
+		J_Tape_Iterator elements = j_tape_iterate(a);
+		REQUIRE(j_tape_next(&elements));
+		CHECK(j_tape_get_number(elements.value) == 1);
+		REQUIRE(j_tape_next(&elements));
+		CHECK(j_tape_count(elements.value) == 2);
+		REQUIRE(j_tape_next(&elements));
+		CHECK(std::string{j_tape_get_string(elements.value)} == "s");
+		CHECK_FALSE(j_tape_next(&elements));
+
+		REQUIRE(j_tape_next(&it));
+		CHECK(j_tape_count(it.value) == 0);
+		REQUIRE(j_tape_next(&it));
+		CHECK(j_tape_get_bool(it.value));
+		REQUIRE(j_tape_next(&it));
+		CHECK(j_tape_get_number(it.value) == -2.5);
+		CHECK_FALSE(j_tape_next(&it));
+
+		j_tape_free(tape);
+
+		auto [failed, failed_err] = j_parse_tape("[1, 2", 5, J_Parse_Options{});
+		CHECK(failed == nullptr);
+		CHECK_FALSE(!failed_err);
+	}
+
+	TEST_CASE("Cursor")
+	{
+		const char* input = R"({"skipped": [1, {"a": "]}\"["}, [[]]], "k\u0065y": "v", "array": [10, "x", [1], {"q": 2}, 20.5], "t": true})";
+		J_Doc* doc = j_doc_open(input, ::strlen(input));
+		J_Cursor root = j_doc_root(doc);
+		REQUIRE(j_cursor_kind(root) == J_JSON_OBJECT);
+
+		J_Cursor value{};
+		J_String string = nullptr;
+		REQUIRE(j_cursor_field(root, "key", &value));
+		REQUIRE(j_cursor_get_string(value, &string));
+		CHECK(std::string{string} == "v");
+
+		// Fields can be visited in any order
+		J_Bool flag = false;
+		REQUIRE(j_cursor_field(root, "t", &value));
+		REQUIRE(j_cursor_get_bool(value, &flag));
+		CHECK(flag);
+
+		J_Cursor array{};
+		REQUIRE(j_cursor_field(root, "array", &array));
+		std::string kinds;
+		J_Cursor element{};
+		for (bool more = j_cursor_first(array, &element); more; more = j_cursor_next(&element))
+			kinds += "xbnsao"[j_cursor_kind(element)];
+		CHECK(kinds == "nsaon");
+
+		J_Number number = 0;
+		REQUIRE(j_cursor_get_number(element, &number));
+		CHECK(number == 20.5);
+
+		CHECK_FALSE(j_cursor_field(root, "missing", &value));
+		CHECK(j_doc_error(doc) == nullptr);
+
+		CHECK_FALSE(j_cursor_get_number(root, &number));
+		CHECK(j_doc_error(doc) != nullptr);
+		j_doc_close(doc);
+
+		const char* malformed = R"({"a": [1, 2}, "b": 1})";
+		doc = j_doc_open(malformed, ::strlen(malformed));
+		CHECK_FALSE(j_cursor_field(j_doc_root(doc), "b", &value));
+		CHECK(j_doc_error(doc) != nullptr);
+		j_doc_close(doc);
+	}
+
+	TEST_CASE("Sax")
+	{
+		struct Events
+		{
+			std::string log;
+		} events;
+
+		J_Sax_Callbacks callbacks{};
+		callbacks.on_null = [](void* user) { ((Events*)user)->log += "n "; return true; };
+		callbacks.on_bool = [](void* user, J_Bool value) { ((Events*)user)->log += value ? "t " : "f "; return true; };
+		callbacks.on_number = [](void* user, J_Number, const char* text, size_t size) {
+			((Events*)user)->log += std::string(text, size) + " ";
+			return true;
+		};
+		callbacks.on_string = [](void* user, const char* string, size_t size) {
+			((Events*)user)->log += "\"" + std::string(string, size) + "\" ";
+			return true;
+		};
+		callbacks.on_key = [](void* user, const char* key, size_t size) {
+			((Events*)user)->log += std::string(key, size) + ": ";
+			return true;
+		};
+		callbacks.on_begin_object = [](void* user) { ((Events*)user)->log += "{ "; return true; };
+		callbacks.on_end_object = [](void* user) { ((Events*)user)->log += "} "; return true; };
+		callbacks.on_begin_array = [](void* user) { ((Events*)user)->log += "[ "; return true; };
+		callbacks.on_end_array = [](void* user) { ((Events*)user)->log += "] "; return true; };
+
+		const char* input = R"({"a": [1.5e1, "s", null], "k\ney": {"b": true, "c": "\u00e9"}, "d": []})";
+		const char* err = j_parse_sax(input, ::strlen(input), &callbacks, &events);
+		REQUIRE_MESSAGE(!err, err);
+		CHECK(events.log == "{ a: [ 1.5e1 \"s\" n ] k\ney: { b: t c: \"\xc3\xa9\" } d: [ ] } ");
+
+		// Stops as soon as a callback says so
+		J_Sax_Callbacks counting{};
+		size_t count = 0;
+		counting.on_number = [](void* user, J_Number, const char*, size_t) { return ++*(size_t*)user < 2; };
+		CHECK(std::string{j_parse_sax("[1, 2, 3]", 9, &counting, &count)} == "Stopped by callback");
+		CHECK(count == 2);
+
+		CHECK_FALSE(!j_parse_sax("[1, 2", 5, &counting, &count));
+	}
+
+	TEST_CASE("Push parser")
+	{
+		const std::string input = R"({"key": [12.5e-1, "a\"b\u00e9", true, null, false], "x": {"": -0}} )";
+		J_Parse_Result expected = j_parse(input.c_str());
+		REQUIRE_MESSAGE(!expected.err, expected.err);
+		std::string expected_dump = j_dump(expected.json);
+		j_free(expected.json);
+
+		// Every chunk size splits some token: strings, numbers, literals and escapes
+		for (size_t chunk_size = 1; chunk_size <= input.size(); chunk_size++)
+		{
+			J_Parser* parser = j_parser_new(J_Parse_Options{});
+			for (size_t i = 0; i < input.size(); i += chunk_size)
+			{
+				std::string chunk = input.substr(i, chunk_size);
+				const char* err = j_parser_feed(parser, chunk.data(), chunk.size());
+				REQUIRE_MESSAGE(!err, err);
+			}
+
+			J_Parse_Result result = j_parser_finish(parser);
+			REQUIRE_MESSAGE(!result.err, result.err);
+			CHECK(std::string{j_dump(result.json)} == expected_dump);
+			j_free(result.json);
+		}
+
+		// A number is only complete once something follows it
+		J_Parser* parser = j_parser_new(J_Parse_Options{});
+		CHECK(j_parser_feed(parser, "12", 2) == nullptr);
+		CHECK(j_parser_feed(parser, "34", 2) == nullptr);
+		J_Parse_Result number = j_parser_finish(parser);
+		REQUIRE_MESSAGE(!number.err, number.err);
+		CHECK(number.json.as_number == 1234);
+
+		parser = j_parser_new(J_Parse_Options{});
+		CHECK(j_parser_feed(parser, "[1,", 3) == nullptr);
+		CHECK(j_parser_feed(parser, "]", 1) != nullptr);
+		CHECK(j_parser_finish(parser).err != nullptr);
+
+		parser = j_parser_new(J_Parse_Options{});
+		CHECK(j_parser_feed(parser, "[\"abc", 5) == nullptr);
+		CHECK(j_parser_finish(parser).err != nullptr);
+	}
+
+	TEST_CASE("Parse many")
+	{
+		std::string input;
+		for (int i = 0; i < 100000; i++)
+			input += i == 5 ? "[1, 2\n" : i % 1000 == 0 ? "\r\n" : "{\"id\": " + std::to_string(i) + ", \"tags\": [\"a\", \"b\"]}\n";
+
+		struct Records
+		{
+			size_t count;
+			size_t errors;
+			size_t next_line;
+			bool in_order;
+		} records{0, 0, 0, true};
+
+		auto check = [](void* user, size_t line, J_Parse_Result result) {
+			Records& records = *(Records*)user;
+			if (records.next_line % 1000 == 0) // blank lines
+				records.next_line++;
+			records.in_order &= line == records.next_line;
+			records.next_line = line + 1;
+			records.count++;
+			if (result.err)
+				records.errors += line == 5;
+			else
+				records.in_order &= j_get_J_Object(result.json).pairs[0].value.as_number == double(line);
+			return true;
+		};
+
+		const char* err = j_parse_many(input.data(), input.size(), J_Parse_Options{}, 4, check, &records);
+		CHECK(err == nullptr);
+		CHECK(records.in_order);
+		CHECK(records.errors == 1);
+		CHECK(records.count == 100000 - 100);
+
+		size_t seen = 0;
+		auto stop = [](void* user, size_t, J_Parse_Result) { return ++*(size_t*)user < 10; };
+		CHECK(std::string{j_parse_many(input.data(), input.size(), J_Parse_Options{}, 4, stop, &seen)} == "Stopped by callback");
+		CHECK(seen == 10);
+	}
+
+	TEST_CASE("Threads")
+	{
+		// A few MB so that the input is split, with strings that look like the commas and brackets
+		// the split looks for
+		std::string input = "[";
+		for (int i = 0; i < 100000; i++)
+			input += std::string{i ? ", " : ""} + R"({"id": )" + std::to_string(i) + R"(, "s": "],[{\\\"\\", "t": ["x,\"]", null]})";
+		input += "]";
+
+		J_Parse_Result expected = j_parse_with_options(input.data(), input.size(), J_Parse_Options{});
+		REQUIRE_MESSAGE(!expected.err, expected.err);
+		std::string expected_dump = j_dump(expected.json);
+		j_free(expected.json);
+
+		for (size_t threads: {2, 3, 16})
+		{
+			J_Parse_Result result = j_parse_with_options(input.data(), input.size(), J_Parse_Options{.threads = threads});
+			REQUIRE_MESSAGE(!result.err, result.err);
+			CHECK(std::string{j_dump(result.json)} == expected_dump);
+			j_free(result.json);
+		}
+
+		std::string double_comma = input;
+		double_comma.insert(double_comma.find(", ", input.size() / 2), ",");
+		CHECK(j_parse_with_options(double_comma.data(), double_comma.size(), J_Parse_Options{.threads = 4}).err != nullptr);
+	}
+
+	TEST_CASE("Interned keys")
+	{
+		const char* input = R"([{"id": 1, "name": "a"}, {"name": "b", "id": 2}, {"i\u0064": 3}, {"id": {"id": 4}}])";
+
+		// Keys of a malloc'd tree are shared too, and each pair still releases its own reference
+		J_Parse_Result tree = j_parse(input);
+		REQUIRE_MESSAGE(!tree.err, tree.err);
+		J_Array records = j_get_J_Array(tree.json);
+		CHECK(records.ptr[0].as_object.pairs[0].key == records.ptr[1].as_object.pairs[1].key);
+		CHECK(records.ptr[0].as_object.pairs[0].key == records.ptr[3].as_object.pairs[0].value.as_object.pairs[0].key);
+		j_free(tree.json);
+
+		auto [document, json, err] = j_parse_document(input, ::strlen(input), J_Parse_Options{});
+		REQUIRE_MESSAGE(!err, err);
+		records = j_get_J_Array(json);
+
+		J_String id = j_document_key(document, "id");
+		REQUIRE(id != nullptr);
+		CHECK(j_document_key(document, "missing") == nullptr);
+
+		J_JSON* value = j_object_find_interned(records.ptr[1].as_object, id);
+		REQUIRE(value != nullptr);
+		CHECK(value->as_number == 2);
+
+		// Keys with escapes are decoded on their own
+		CHECK(std::string{records.ptr[2].as_object.pairs[0].key} == "id");
+		CHECK(j_object_find_interned(records.ptr[2].as_object, id) == nullptr);
+
+		j_document_free(document);
+	}
+
+	TEST_CASE("Object get")
+	{
+		const char* small_input = R"({"a": 1, "b\u0000c": 2, "a": 3})";
+		J_Parse_Result small = j_parse(small_input);
+		REQUIRE_MESSAGE(!small.err, small.err);
+		CHECK(j_object_get(small.json.as_object, "a", 1)->as_number == 1);
+		CHECK(j_object_get(small.json.as_object, "b\0c", 3)->as_number == 2);
+		CHECK(j_object_get(small.json.as_object, "b", 1) == nullptr);
+		j_free(small.json);
+
+		// Past OBJECT_INDEX_MIN_COUNT pairs lookups go through the index, in trees and documents alike
+		std::string input = "{";
+		for (int i = 0; i < 1000; i++)
+			input += "\"key" + std::to_string(i) + "\": " + std::to_string(i) + ", ";
+		input += R"("key7": -1, "": 0})";
+
+		J_Parse_Result tree = j_parse(input.c_str());
+		REQUIRE_MESSAGE(!tree.err, tree.err);
+		auto [document, json, err] = j_parse_document(input.data(), input.size(), J_Parse_Options{});
+		REQUIRE_MESSAGE(!err, err);
+
+		for (J_Object object: {tree.json.as_object, json.as_object})
+		{
+			for (int i = 0; i < 1000; i++)
+			{
+				std::string key = "key" + std::to_string(i);
+				J_JSON* value = j_object_get(object, key.data(), key.size());
+				REQUIRE(value != nullptr);
+				CHECK(value->as_number == i);
+			}
+			CHECK(j_object_get(object, "", 0)->as_number == 0);
+			CHECK(j_object_get(object, "key1000", 7) == nullptr);
+			CHECK(j_object_get(object, "key", 3) == nullptr);
+		}
+
+		j_free(tree.json);
+		j_document_free(document);
+	}
+
+	TEST_CASE("Pointer")
+	{
+		// REF: https://www.rfc-editor.org/rfc/rfc6901#section-5
+		std::string input = R"({"foo": ["bar", "baz"], "": 0, "a/b": 1, "c%d": 2, "e^f": 3, "g|h": 4, "i\\j": 5, "k\"l": 6, " ": 7, "m~n": 8, "big": {)";
+		for (int i = 0; i < 100; i++)
+			input += "\"key" + std::to_string(i) + "\": [" + std::to_string(i) + "], ";
+		input += R"("01": "zero one"}})";
+
+		J_Parse_Result result = j_parse(input.c_str());
+		REQUIRE_MESSAGE(!result.err, result.err);
+
+		auto eval = [&](const char* text) -> J_JSON* {
+			auto [pointer, err] = j_pointer_compile(text, strlen(text));
+			REQUIRE_MESSAGE(!err, err);
+			J_JSON* value = j_pointer_eval(&result.json, pointer);
+			j_pointer_free(pointer);
+			return value;
+		};
+
+		CHECK(eval("") == &result.json);
+		CHECK(eval("/foo")->kind == J_JSON_ARRAY);
+		CHECK(std::string{eval("/foo/0")->as_string} == "bar");
+		CHECK(std::string{eval("/foo/1")->as_string} == "baz");
+		CHECK(eval("/")->as_number == 0);
+		CHECK(eval("/a~1b")->as_number == 1);
+		CHECK(eval("/c%d")->as_number == 2);
+		CHECK(eval("/e^f")->as_number == 3);
+		CHECK(eval("/g|h")->as_number == 4);
+		CHECK(eval("/i\\j")->as_number == 5);
+		CHECK(eval("/k\"l")->as_number == 6);
+		CHECK(eval("/ ")->as_number == 7);
+		CHECK(eval("/m~0n")->as_number == 8);
+
+		// Past OBJECT_INDEX_MIN_COUNT pairs the precomputed hashes are used
+		CHECK(eval("/big/key42/0")->as_number == 42);
+		CHECK(std::string{eval("/big/01")->as_string} == "zero one");
+		CHECK(eval("/big/key100") == nullptr);
+
+		CHECK(eval("/foo/2") == nullptr);
+		CHECK(eval("/foo/-") == nullptr);
+		CHECK(eval("/foo/01") == nullptr);
+		CHECK(eval("/foo/0/x") == nullptr);
+		CHECK(eval("/foo/99999999999999999999999") == nullptr);
+		CHECK(eval("/missing") == nullptr);
+
+		CHECK(j_pointer_compile("foo", 3).err != nullptr);
+		CHECK(j_pointer_compile("/foo~", 5).err != nullptr);
+		CHECK(j_pointer_compile("/foo~2", 6).err != nullptr);
+		j_free(result.json);
+	}
+
+	TEST_CASE("Query")
+	{
+		// REF: https://goessner.net/articles/JsonPath/index.html#e3
+		const char* input = R"({"store": {
+			"book": [
+				{"category": "reference", "author": "Nigel Rees", "title": "Sayings of the Century", "price": 8.95},
+				{"category": "fiction", "author": "Evelyn Waugh", "title": "Sword of Honour", "price": 12.99},
+				{"category": "fiction", "author": "Herman Melville", "title": "Moby Dick", "isbn": "0-553-21311-3", "price": 8.99},
+				{"category": "fiction", "author": "J. R. R. Tolkien", "title": "The Lord of the Rings", "isbn": "0-395-19395-8", "price": 22.99}
+			],
+			"bicycle": {"color": "red", "price": 19.95}
+		}})";
+
+		auto query = [](const char* json, const char* path, J_PARSE_ENGINE engine) -> std::vector<std::string> {
+			auto [compiled, compile_err] = j_query_compile(path, strlen(path));
+			REQUIRE_MESSAGE(!compile_err, compile_err);
+			J_Query_Result result = j_query(json, strlen(json), compiled, J_Parse_Options{.engine = engine});
+			j_query_free(compiled);
+			if (result.err)
+				return {std::string{"error: "} + result.err};
+
+			std::vector<std::string> values;
+			for (size_t i = 0; i < result.count; i++)
+				values.push_back(j_dump(result.values[i]));
+			j_document_free(result.document);
+			return values;
+		};
+
+		using Values = std::vector<std::string>;
+		for (J_PARSE_ENGINE engine: {J_PARSE_ENGINE_TABLE, J_PARSE_ENGINE_STATE_MACHINE})
+		{
+			CHECK(query(input, "$.store.book[*].author", engine) == Values{R"("Nigel Rees")", R"("Evelyn Waugh")", R"("Herman Melville")", R"("J. R. R. Tolkien")"});
+			CHECK(query(input, "$['store'][\"bicycle\"]", engine) == Values{R"({"color":"red","price":19.95})"});
+			CHECK(query(input, "$.store.*.price", engine) == Values{"19.95"});
+			CHECK(query(input, "$.store.book[2].title", engine) == Values{R"("Moby Dick")"});
+			CHECK(query(input, "$.store.book[1:3].price", engine) == Values{"12.99", "8.99"});
+			CHECK(query(input, "$.store.book[::2].title", engine) == Values{R"("Sayings of the Century")", R"("Moby Dick")"});
+			CHECK(query(input, "$.store.book[?(@.isbn)].title", engine) == Values{R"("Moby Dick")", R"("The Lord of the Rings")"});
+			CHECK(query(input, "$.store.book[?(@.price < 10)].title", engine) == Values{R"("Sayings of the Century")", R"("Moby Dick")"});
+			CHECK(query(input, "$.store.book[?@.category == 'fiction'].title", engine).size() == 3);
+			CHECK(query(input, "$.store.book[?(@.category != \"fiction\")].author", engine) == Values{R"("Nigel Rees")"});
+			CHECK(query(input, "$.store.book[9]", engine).empty());
+			CHECK(query(input, "$.store.bicycle[0]", engine).empty());
+		}
+
+		CHECK(query("[1, [2, 3], {\"a\": 4}]", "$", J_PARSE_ENGINE_TABLE) == Values{R"([1,[2,3],{"a":4}])"});
+		CHECK(query("[1, 2, 3, 4, 5]", "$[?(@ >= 3)]", J_PARSE_ENGINE_TABLE) == Values{"3", "4", "5"});
+		CHECK(query(R"({"a": {"b": 1}, "c": {"b": 2}, "d": 3})", "$[?(@.b == 2)]", J_PARSE_ENGINE_TABLE) == Values{R"({"b":2})"});
+		CHECK(query(R"([{"key": "vé"}])", "$[?(@.key == 'vé')].key", J_PARSE_ENGINE_TABLE) == Values{"\"v\xc3\xa9\""});
+
+		// Values that can't match are only checked for balanced brackets, the rest like j_parse would
+		CHECK(query(R"({"skip": [1, tru, {"x": }], "keep": 1})", "$.keep", J_PARSE_ENGINE_TABLE) == Values{"1"});
+		CHECK(query(R"({"skip": [}, "keep": 1})", "$.keep", J_PARSE_ENGINE_TABLE) == Values{"error: Unexpected terminal"});
+		CHECK(query(R"({"keep": [1,]})", "$.keep", J_PARSE_ENGINE_TABLE) == Values{"error: Unexpected terminal"});
+		CHECK(query(R"({"keep": 1,})", "$.keep", J_PARSE_ENGINE_TABLE) == Values{"error: Unexpected terminal"});
+		CHECK(query(R"({"keep": 1} 2)", "$.keep", J_PARSE_ENGINE_TABLE) == Values{"error: Trailing characters"});
+		CHECK(query(R"({"keep": )", "$.keep", J_PARSE_ENGINE_TABLE) == Values{"error: Incomplete"});
+
+		for (const char* path: {"", "a.b", "$..a", "$.", "$[-1]", "$[1:2:0]", "$['a'", "$[?(@.a ~ 1)]", "$[?(@.a == x)]", "$[a]"})
+			CHECK_MESSAGE(j_query_compile(path, strlen(path)).err != nullptr, path);
+	}
+
+	TEST_CASE("Escapes")
+	{
+		auto [json, err] = j_parse(R"(["é\n\"\\\/", "😀", "a\u0000b", "\udc00", {"k\tey": "longer than a vector, € then plain text"}])");
+		REQUIRE_MESSAGE(!err, err);
+
+		J_Array array = json.as_array;
+		CHECK(std::string{array.ptr[0].as_string} == "\xc3\xa9\n\"\\/");
+		CHECK(std::string{array.ptr[1].as_string} == "\xf0\x9f\x98\x80");
+		CHECK(j_string_length(array.ptr[2].as_string) == 3);
+		CHECK(std::string(array.ptr[2].as_string, 3) == std::string("a\0b", 3));
+		CHECK(std::string{array.ptr[3].as_string} == "\xef\xbf\xbd"); // lone surrogate
+		CHECK(std::string{array.ptr[4].as_object.pairs[0].key} == "k\tey");
+		CHECK(std::string{array.ptr[4].as_object.pairs[0].value.as_string} == "longer than a vector, \xe2\x82\xac then plain text");
+
+		// Escaped again, only where JSON requires it
+		CHECK(std::string{j_dump(json)} == "[\"\xc3\xa9\\n\\\"\\\\/\",\"\xf0\x9f\x98\x80\",\"a\\u0000b\",\"\xef\xbf\xbd\",{\"k\\tey\":\"longer than a vector, \xe2\x82\xac then plain text\"}]");
+		j_free(json);
+	}
+
 	// REF: https://developer.spotify.com/documentation/web-api/reference/get-an-album
 	TEST_CASE("Dump")
 	{
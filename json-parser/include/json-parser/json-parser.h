@@ -1,5 +1,6 @@
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "json-parser/Exports.h"
 
@@ -34,6 +35,17 @@ typedef struct J_Array
 	size_t count;
 } J_Array;
 
+typedef struct J_Number_Text
+{
+	const char* ptr;
+	size_t count;
+} J_Number_Text;
+
+typedef enum J_JSON_FLAGS
+{
+	J_JSON_FLAG_NUMBER_TEXT = 1 << 0, // number kept as `as_number_text`, see J_Parse_Options.lazy_numbers
+} J_JSON_FLAGS;
+
 typedef struct J_Pair J_Pair;
 typedef struct J_Object
 {
@@ -44,11 +56,13 @@ typedef struct J_Object
 struct J_JSON
 {
 	J_JSON_KIND kind;
+	uint32_t flags; // J_JSON_FLAGS
 
 	union
 	{
 		bool as_bool;
 		double as_number;
+		J_Number_Text as_number_text;
 		J_String as_string;
 		J_Array as_array;
 		J_Object as_object;
@@ -67,18 +81,251 @@ typedef struct J_Parse_Result
 	const char* err;
 } J_Parse_Result;
 
+typedef enum J_PARSE_MODE
+{
+	J_PARSE_MODE_STREAMING, // tokens are lexed on demand, the input is touched once (default)
+	J_PARSE_MODE_TOKENIZE,  // the whole input is lexed into a token buffer before parsing
+} J_PARSE_MODE;
+
+typedef enum J_PARSE_ENGINE
+{
+	J_PARSE_ENGINE_TABLE,         // LL(1) driver over the grammar's prediction table, the reference (default)
+	J_PARSE_ENGINE_STATE_MACHINE, // the same grammar hand-specialized into a state machine
+} J_PARSE_ENGINE;
+
+#define J_PARSE_DEFAULT_MAX_DEPTH 1024
+
+// Zero-initialized options are the defaults used by j_parse
+typedef struct J_Parse_Options
+{
+	J_PARSE_MODE mode;
+	J_PARSE_ENGINE engine;
+
+	// Numbers keep a view of their text in the input instead of being converted, the input must
+	// outlive the result. Read them with j_get_J_Number, j_get_number_int64 or j_get_number_text.
+	bool lazy_numbers;
+
+	// Containers nested deeper than this fail with "Nesting too deep", 0 for
+	// J_PARSE_DEFAULT_MAX_DEPTH. The parse stacks are allocated up front for this depth.
+	size_t max_depth;
+
+	// Threads for j_parse_with_options, 0 or 1 parse on the calling thread. A top-level array or
+	// object of a few MB or more is cut between its values and the pieces are parsed concurrently.
+	// The other entry points ignore it.
+	size_t threads;
+} J_Parse_Options;
+
 JSON_PARSER_EXPORT J_Version
 j_version();
 
 JSON_PARSER_EXPORT J_Parse_Result
 j_parse(const char* json_string);
 
+JSON_PARSER_EXPORT J_Parse_Result
+j_parse_with_options(const char* json_string, size_t size, J_Parse_Options options);
+
 JSON_PARSER_EXPORT void
 j_free(J_JSON json);
 
+// A parsed document whose nodes, pairs and strings all live in one arena, released at once by
+// j_document_free. Its values must not be passed to j_free.
+typedef struct J_Document J_Document;
+
+typedef struct J_Document_Result
+{
+	J_Document* document; // null on error
+	J_JSON json;
+	const char* err;
+} J_Document_Result;
+
+JSON_PARSER_EXPORT J_Document_Result
+j_parse_document(const char* json_string, size_t size, J_Parse_Options options);
+
+JSON_PARSER_EXPORT void
+j_document_free(J_Document* document);
+
+// Object keys without escapes are interned: equal keys share one J_String within a document, or
+// within a tree from j_parse_with_options, so that they can be compared by pointer.
+// Returns the document's interned key equal to `key`, null if no object in it has such a key.
+JSON_PARSER_EXPORT J_String
+j_document_key(const J_Document* document, const char* key);
+
+// Value of the pair of `object` whose key is the interned `key`, compared by pointer, null if none
+JSON_PARSER_EXPORT J_JSON*
+j_object_find_interned(J_Object object, J_String key);
+
+// A parsed document as one contiguous array of tagged 64-bit words in document order, instead of a
+// tree of separately allocated blocks. Every container's first word holds the index past its end,
+// so skipping a subtree is O(1). Strings live with the tape and are released by j_tape_free.
+typedef struct J_Tape J_Tape;
+
+typedef struct J_Tape_Result
+{
+	J_Tape* tape; // null on error
+	const char* err;
+} J_Tape_Result;
+
+// A value's position on its tape, valid until j_tape_free
+typedef struct J_Tape_Value
+{
+	const J_Tape* tape;
+	size_t index;
+} J_Tape_Value;
+
+// Walks an array's elements, or an object's keys and values, in document order:
+//   J_Tape_Iterator it = j_tape_iterate(container);
+//   while (j_tape_next(&it)) { ... it.key, it.value ... }
+typedef struct J_Tape_Iterator
+{
+	J_Tape_Value key; // objects only
+	J_Tape_Value value;
+	size_t _next, _end;
+} J_Tape_Iterator;
+
+JSON_PARSER_EXPORT J_Tape_Result
+j_parse_tape(const char* json_string, size_t size, J_Parse_Options options);
+
+JSON_PARSER_EXPORT void
+j_tape_free(J_Tape* tape);
+
+JSON_PARSER_EXPORT J_Tape_Value
+j_tape_root(const J_Tape* tape);
+
+JSON_PARSER_EXPORT J_JSON_KIND
+j_tape_kind(J_Tape_Value value);
+
+JSON_PARSER_EXPORT J_Bool
+j_tape_get_bool(J_Tape_Value value);
+
+JSON_PARSER_EXPORT J_Number
+j_tape_get_number(J_Tape_Value value);
+
+JSON_PARSER_EXPORT J_String
+j_tape_get_string(J_Tape_Value value);
+
+// Elements of an array or pairs of an object, without walking them
+JSON_PARSER_EXPORT size_t
+j_tape_count(J_Tape_Value value);
+
+// The value right after `value` and its subtree on the tape
+JSON_PARSER_EXPORT J_Tape_Value
+j_tape_skip(J_Tape_Value value);
+
+JSON_PARSER_EXPORT J_Tape_Iterator
+j_tape_iterate(J_Tape_Value container);
+
+JSON_PARSER_EXPORT bool
+j_tape_next(J_Tape_Iterator* it);
+
+// Event callbacks for j_parse_sax, any of them can be null. Returning false stops the parse, which
+// then fails with "Stopped by callback". Strings and keys are decoded but not null-terminated, and
+// only valid during the call; `text` points at a number as written in the input.
+typedef struct J_Sax_Callbacks
+{
+	bool (*on_null)(void* user);
+	bool (*on_bool)(void* user, J_Bool value);
+	bool (*on_number)(void* user, J_Number value, const char* text, size_t size);
+	bool (*on_string)(void* user, const char* string, size_t size);
+	bool (*on_key)(void* user, const char* key, size_t size);
+	bool (*on_begin_object)(void* user);
+	bool (*on_end_object)(void* user);
+	bool (*on_begin_array)(void* user);
+	bool (*on_end_array)(void* user);
+} J_Sax_Callbacks;
+
+// Parses the input and reports its values to `callbacks` in document order, without building a
+// document. Returns the error, null on success. Events seen before an error are not taken back.
+JSON_PARSER_EXPORT const char*
+j_parse_sax(const char* json_string, size_t size, const J_Sax_Callbacks* callbacks, void* user);
+
+// Push parser for input that arrives in chunks: each chunk is parsed as soon as it is fed, and only
+// a token cut off at its end is copied until the next chunk completes it. Chunks can be freed once
+// fed. J_Parse_Options.mode and lazy_numbers are ignored, numbers are always converted.
+typedef struct J_Parser J_Parser;
+
+JSON_PARSER_EXPORT J_Parser*
+j_parser_new(J_Parse_Options options);
+
+// Returns the error, null on success. Once a chunk fails every later call fails the same way.
+JSON_PARSER_EXPORT const char*
+j_parser_feed(J_Parser* parser, const char* chunk, size_t size);
+
+// Ends the input and frees the parser, the result is freed with j_free
+JSON_PARSER_EXPORT J_Parse_Result
+j_parser_finish(J_Parser* parser);
+
+// Called by j_parse_many once per record in input order, `line` counts from 0 and includes blank
+// lines. The record's value is only valid during the call and must not be passed to j_free.
+// Returning false stops the parse.
+typedef bool (*J_Parse_Many_Callback)(void* user, size_t line, J_Parse_Result result);
+
+// Parses newline-delimited JSON (NDJSON, JSON Lines) on `threads` worker threads, 0 for one per
+// core. A record that fails does not stop the others, its error is passed to the callback. Blank
+// lines are skipped. Returns "Stopped by callback" if the callback stopped the parse, else null.
+JSON_PARSER_EXPORT const char*
+j_parse_many(const char* json_string, size_t size, J_Parse_Options options, size_t threads, J_Parse_Many_Callback callback, void* user);
+
+// On-demand access: nothing is parsed when a document is opened, values are lexed only when a
+// cursor reaches them, and the subtrees in between are skipped by matching brackets without being
+// validated. The input must outlive the document.
+typedef struct J_Doc J_Doc;
+
+// A value in an on-demand document, cursors are independent and can be revisited in any order
+typedef struct J_Cursor
+{
+	J_Doc* doc;
+	size_t offset; // of the value's first byte in the input
+} J_Cursor;
+
+JSON_PARSER_EXPORT J_Doc*
+j_doc_open(const char* json_string, size_t size);
+
+// Releases the document and the strings its cursors returned
+JSON_PARSER_EXPORT void
+j_doc_close(J_Doc* doc);
+
+// The error of the last cursor call that failed on malformed input, null if there was none
+JSON_PARSER_EXPORT const char*
+j_doc_error(const J_Doc* doc);
+
+JSON_PARSER_EXPORT J_Cursor
+j_doc_root(J_Doc* doc);
+
+// From the value's first byte only, malformed values are reported by the getters
+JSON_PARSER_EXPORT J_JSON_KIND
+j_cursor_kind(J_Cursor cursor);
+
+// The cursor calls below return false when there's no such value, or when the input is malformed,
+// which j_doc_error tells apart
+
+JSON_PARSER_EXPORT bool
+j_cursor_field(J_Cursor object, const char* key, J_Cursor* value);
+
+// First element of an array, or first value of an object
+JSON_PARSER_EXPORT bool
+j_cursor_first(J_Cursor container, J_Cursor* child);
+
+// Moves to the next element of the same array, or the next value of the same object
+JSON_PARSER_EXPORT bool
+j_cursor_next(J_Cursor* cursor);
+
+JSON_PARSER_EXPORT bool
+j_cursor_get_number(J_Cursor cursor, J_Number* number);
+
+JSON_PARSER_EXPORT bool
+j_cursor_get_bool(J_Cursor cursor, J_Bool* value);
+
+// The decoded string lives until j_doc_close
+JSON_PARSER_EXPORT bool
+j_cursor_get_string(J_Cursor cursor, J_String* string);
+
 JSON_PARSER_EXPORT const char*
 j_dump(J_JSON json);
 
+// Heap allocations made by the library on the calling thread so far, for profiling
+JSON_PARSER_EXPORT size_t
+j_allocation_count();
+
 #define j_get(J_TYPE, json) j_get_##J_TYPE(json)
 
 JSON_PARSER_EXPORT J_Bool
@@ -87,15 +334,91 @@ j_get_J_Bool(J_JSON json);
 JSON_PARSER_EXPORT J_Number
 j_get_J_Number(J_JSON json);
 
+// Exact conversion, fails if the number is not an integer or is out of range; numbers parsed
+// without lazy_numbers are checked after their conversion to double
+JSON_PARSER_EXPORT bool
+j_get_number_int64(J_JSON json, int64_t* value);
+
+// The number's text in the input, null for numbers parsed without lazy_numbers
+JSON_PARSER_EXPORT const char*
+j_get_number_text(J_JSON json, size_t* count);
+
 JSON_PARSER_EXPORT J_String
 j_get_J_String(J_JSON json);
 
+// Size in bytes of a decoded string or key, without the null terminator; strings with "\u0000" in
+// them are longer than their strlen
+JSON_PARSER_EXPORT size_t
+j_string_length(J_String string);
+
 JSON_PARSER_EXPORT J_Array
 j_get_J_Array(J_JSON json);
 
 JSON_PARSER_EXPORT J_Object
 j_get_J_Object(J_JSON json);
 
+// Value of the first pair of `object` whose key is the `size` bytes at `key`, null if none. Large
+// objects get a hash index on their first lookup, which lives as long as the object does; lookups
+// from several threads at once are safe.
+JSON_PARSER_EXPORT J_JSON*
+j_object_get(J_Object object, const char* key, size_t size);
+
+// A JSON Pointer (RFC 6901) compiled once to be evaluated against any number of documents
+typedef struct J_Pointer J_Pointer;
+
+typedef struct J_Pointer_Result
+{
+	J_Pointer* pointer; // null on error
+	const char* err;
+} J_Pointer_Result;
+
+// `pointer` is e.g. "/a/b/3/c", "" refers to the whole document
+JSON_PARSER_EXPORT J_Pointer_Result
+j_pointer_compile(const char* pointer, size_t size);
+
+JSON_PARSER_EXPORT void
+j_pointer_free(J_Pointer* pointer);
+
+// The value `pointer` refers to under `root`, null if there is none
+JSON_PARSER_EXPORT J_JSON*
+j_pointer_eval(J_JSON* root, const J_Pointer* pointer);
+
+// A JSONPath query compiled once to be run against any number of inputs. The supported subset is
+// the root `$` followed by
+//   .name ['name']        a member of an object
+//   .* [*]                every member of an object or element of an array
+//   [3] [1:10:2]          array elements by index or slice, none of them negative
+//   [?(@.a.b < 3)]        children for which the comparison holds, with ==, !=, <, <=, >, >=
+//                         against a number, string, true, false or null, or [?(@.a)] for existence
+typedef struct J_Query J_Query;
+
+typedef struct J_Query_Compile_Result
+{
+	J_Query* query; // null on error
+	const char* err;
+} J_Query_Compile_Result;
+
+JSON_PARSER_EXPORT J_Query_Compile_Result
+j_query_compile(const char* path, size_t size);
+
+JSON_PARSER_EXPORT void
+j_query_free(J_Query* query);
+
+// The values matched, in document order, live in `document` and are released with it
+typedef struct J_Query_Result
+{
+	J_Document* document; // null on error
+	J_JSON* values;
+	size_t count;
+	const char* err;
+} J_Query_Result;
+
+// Runs `query` while lexing the input: subtrees that can't match are skipped by counting brackets
+// and only checked for balanced brackets, and only matched values are built. Those are fully
+// validated, as are the containers the query walks through. J_Parse_Options.mode is ignored.
+JSON_PARSER_EXPORT J_Query_Result
+j_query(const char* json_string, size_t size, const J_Query* query, J_Parse_Options options);
+
 #ifdef __cplusplus
 }
 #endif
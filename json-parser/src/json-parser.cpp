@@ -1,20 +1,48 @@
 #include "json-parser/json-parser.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <condition_variable>
 #include <initializer_list>
 #include <iostream>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <random>
 #include <span>
-#include <stack>
 #include <string>
-#include <unordered_map>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 #include <assert.h>
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
 
 #include <utf8proc.h>
 
 #include <tracy/Tracy.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSON_PARSER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+#include "powers-of-five.h"
+
 // OPTIMIZE:
 // * Profile standard library RAII containers and search for replacements
 #define unreachable(msg) assert(!msg)
@@ -38,14 +66,6 @@ struct String_View
 	{
 	}
 
-	const char*
-	cstr_new()
-	{
-		char* str = (char*)::malloc(count + 1);
-		::memcpy((void*)str, ptr, count);
-		str[count] = '\0';
-		return str;
-	}
 };
 
 struct Error
@@ -96,6 +116,167 @@ struct Result
 	~Result() = default;
 };
 
+// Heap allocations made by the library on this thread, reported by j_allocation_count
+static thread_local size_t ALLOCATION_COUNT = 0;
+
+static inline void*
+j_malloc(size_t size)
+{
+	ALLOCATION_COUNT++;
+	return ::malloc(size);
+}
+
+static inline void*
+j_realloc(void* ptr, size_t size)
+{
+	ALLOCATION_COUNT++;
+	return ::realloc(ptr, size);
+}
+
+// Contiguous stack allocated once with a fixed capacity, it never grows: callers check `full`
+// before pushing
+template<typename T>
+struct Fixed_Stack
+{
+	T* _items;
+	size_t _count;
+	size_t _capacity;
+
+	explicit Fixed_Stack(size_t capacity)
+		: _items((T*)j_malloc(capacity * sizeof(T))), _count(0), _capacity(capacity)
+	{
+	}
+
+	Fixed_Stack(const Fixed_Stack&) = delete;
+
+	Fixed_Stack&
+	operator=(const Fixed_Stack&) = delete;
+
+	~Fixed_Stack()
+	{
+		while (_count > 0)
+			pop();
+		::free(_items);
+	}
+
+	bool
+	empty() const
+	{
+		return _count == 0;
+	}
+
+	bool
+	full() const
+	{
+		return _count == _capacity;
+	}
+
+	size_t
+	size() const
+	{
+		return _count;
+	}
+
+	T&
+	top()
+	{
+		assert(_count > 0);
+		return _items[_count - 1];
+	}
+
+	template<typename... TArgs>
+	T&
+	push(TArgs&&... args)
+	{
+		assert(full() == false);
+		return *new (_items + _count++) T(std::forward<TArgs>(args)...);
+	}
+
+	void
+	pop()
+	{
+		assert(_count > 0);
+		_items[--_count].~T();
+	}
+};
+
+// Contiguous stack of trivially copyable items that grows by doubling and keeps its capacity
+// when popped, so that it can be reused as scratch space for a whole document
+template<typename T>
+struct Scratch_Stack
+{
+	static_assert(std::is_trivially_copyable_v<T>);
+
+	T* _items;
+	size_t _count;
+	size_t _capacity;
+
+	Scratch_Stack() : _items(nullptr), _count(0), _capacity(0)
+	{
+	}
+
+	Scratch_Stack(const Scratch_Stack&) = delete;
+
+	Scratch_Stack&
+	operator=(const Scratch_Stack&) = delete;
+
+	~Scratch_Stack()
+	{
+		::free(_items);
+	}
+
+	size_t
+	size() const
+	{
+		return _count;
+	}
+
+	T*
+	data()
+	{
+		return _items;
+	}
+
+	inline void
+	push(const T& item)
+	{
+		if (_count == _capacity)
+		{
+			_capacity = _capacity ? _capacity * 2 : 256;
+			_items = (T*)j_realloc(_items, _capacity * sizeof(T));
+		}
+		_items[_count++] = item;
+	}
+
+	// Makes room for `count` more items without pushing them
+	inline void
+	reserve(size_t count)
+	{
+		if (_count + count <= _capacity)
+			return;
+
+		_capacity = std::max(_capacity * 2, _count + count);
+		_items = (T*)j_realloc(_items, _capacity * sizeof(T));
+	}
+
+	inline void
+	append(const T* items, size_t count)
+	{
+		reserve(count);
+		if (count > 0)
+			::memcpy(_items + _count, items, count * sizeof(T));
+		_count += count;
+	}
+
+	// Drops every item from `count` onwards
+	void
+	truncate(size_t count)
+	{
+		assert(count <= _count);
+		_count = count;
+	}
+};
+
 using Rune = utf8proc_int32_t;
 struct JSON_Token
 {
@@ -226,718 +407,4496 @@ struct JSON_Token
 		return is_terminal() == other.is_terminal() && kind() == other.kind();
 	}
 
-	static void
+	static constexpr void
 	fill_ptable(PTable& ptable);
 };
 
+// Token tape entry for J_PARSE_MODE_TOKENIZE: the terminal packed with the 32 bit offset and 24 bit
+// size of its data relative to the input, a third of a JSON_Token. Tokens whose data starts past
+// 4 GB or is longer than 16 MB are marked wide: the high bits of the offset take the size's
+// place and the full size follows in an extension entry.
+struct Compact_Token
+{
+	enum KIND : uint8_t
+	{
+		KIND_END_OF_INPUT,
+		KIND_null,
+		KIND_true,
+		KIND_false,
+		KIND_comma,
+		KIND_lbracket,
+		KIND_rbracket,
+		KIND_lbrace,
+		KIND_rbrace,
+		KIND_colon,
+		KIND_backslash,
+		KIND_number,
+		KIND_string,
+
+		KIND_COUNT,
+
+		KIND_WIDE = 0x80,
+	};
+
+	static constexpr JSON_Token::KIND TERMINALS[KIND_COUNT]{
+		JSON_Token::META_END_OF_INPUT,
+		JSON_Token::T_null,
+		JSON_Token::T_true,
+		JSON_Token::T_false,
+		JSON_Token::T_comma,
+		JSON_Token::T_lbracket,
+		JSON_Token::T_rbracket,
+		JSON_Token::T_lbrace,
+		JSON_Token::T_rbrace,
+		JSON_Token::T_colon,
+		JSON_Token::T_backslash,
+		JSON_Token::T_number,
+		JSON_Token::T_string,
+	};
+
+	static constexpr uint32_t MAX_OFFSET = UINT32_MAX;
+	static constexpr uint32_t MAX_SIZE = (1 << 24) - 1;
+
+	uint32_t offset;
+	uint32_t kind : 8;
+	uint32_t size : 24;
+
+	static constexpr KIND
+	compact_kind(JSON_Token::KIND kind)
+	{
+		switch (kind)
+		{
+		case JSON_Token::META_END_OF_INPUT: return KIND_END_OF_INPUT;
+		case JSON_Token::T_null:            return KIND_null;
+		case JSON_Token::T_true:            return KIND_true;
+		case JSON_Token::T_false:           return KIND_false;
+		case JSON_Token::T_comma:           return KIND_comma;
+		case JSON_Token::T_lbracket:        return KIND_lbracket;
+		case JSON_Token::T_rbracket:        return KIND_rbracket;
+		case JSON_Token::T_lbrace:          return KIND_lbrace;
+		case JSON_Token::T_rbrace:          return KIND_rbrace;
+		case JSON_Token::T_colon:           return KIND_colon;
+		case JSON_Token::T_backslash:       return KIND_backslash;
+		case JSON_Token::T_number:          return KIND_number;
+		case JSON_Token::T_string:          return KIND_string;
+		default:
+			unreachable("Not a terminal");
+			return KIND_COUNT;
+		}
+	}
+
+	static inline void
+	push(std::vector<Compact_Token>& tape, const char* base, const JSON_Token& token)
+	{
+		KIND kind = compact_kind(token.kind());
+		if (kind != KIND_number && kind != KIND_string)
+			return tape.push_back(Compact_Token{.offset = 0, .kind = kind, .size = 0});
+
+		String_View data = token.data();
+		uint64_t offset = data.ptr - base;
+		if (offset <= MAX_OFFSET && data.count <= MAX_SIZE)
+			return tape.push_back(Compact_Token{.offset = uint32_t(offset), .kind = kind, .size = uint32_t(data.count)});
+
+		uint64_t size = data.count;
+		assert((offset >> 32) <= MAX_SIZE);
+		tape.push_back(Compact_Token{.offset = uint32_t(offset), .kind = uint32_t(kind | KIND_WIDE), .size = uint32_t(offset >> 32)});
+		tape.push_back(Compact_Token{.offset = uint32_t(size), .kind = 0, .size = uint32_t(size >> 32)});
+	}
+
+	// Decodes the token at `it` and moves past it (and its extension entry, if any)
+	static inline JSON_Token
+	pop(const Compact_Token*& it, const char* base)
+	{
+		Compact_Token word = *it++;
+		if ((word.kind & KIND_WIDE) == 0)
+			return JSON_Token{TERMINALS[word.kind], String_View{base + word.offset, word.size}};
+
+		Compact_Token extension = *it++;
+		uint64_t offset = word.offset | (uint64_t(word.size) << 32);
+		uint64_t size = extension.offset | (uint64_t(extension.size) << 32);
+		return JSON_Token{TERMINALS[word.kind & ~KIND_WIDE], String_View{base + offset, size}};
+	}
+};
+static_assert(sizeof(Compact_Token) == 8);
+
 struct Production
 {
-	JSON_Token lhs;
-	std::vector<JSON_Token> rhs;
+	static constexpr size_t MAX_RHS = 5;
+
+	bool defined;
+	uint8_t count; // META_EPS isn't stored
+	JSON_Token::KIND rhs[MAX_RHS];
 };
 
+// Dense LL(1) prediction table, indexed by nonterminal and compact terminal kind. Generated at
+// compile time from fill_ptable, a conflicting production fails the build.
 struct PTable
 {
-	std::unordered_map<JSON_Token::KIND, std::unordered_map<JSON_Token::KIND, Production>> table;
+	static constexpr size_t NONTERMINAL_COUNT = JSON_Token::N_MORE_ELEMENTS - JSON_Token::N_V + 2; // and META_START
 
-	void
-	add(JSON_Token::KIND nonterminal, JSON_Token::KIND terminal, std::initializer_list<JSON_Token> rhs)
+	Production table[NONTERMINAL_COUNT][Compact_Token::KIND_COUNT];
+
+	static constexpr size_t
+	nonterminal_index(JSON_Token::KIND nonterminal)
 	{
-		assert(table[nonterminal].contains(terminal) == false);
-		table[nonterminal][terminal] = Production{nonterminal, rhs};
+		return nonterminal == JSON_Token::META_START ? 0 : nonterminal - JSON_Token::N_V + 1;
 	}
 
-	Result<Production>
-	operator()(JSON_Token::KIND nonterminal, JSON_Token::KIND terminal) const
+	constexpr void
+	add(JSON_Token::KIND nonterminal, JSON_Token::KIND terminal, std::initializer_list<JSON_Token::KIND> rhs)
 	{
-		ZoneScoped;
+		Production& production = table[nonterminal_index(nonterminal)][Compact_Token::compact_kind(terminal)];
+		assert(production.defined == false);
 
-		auto& productions = table.at(nonterminal);
-		if (productions.contains(terminal) == false)
-			return Error{"Unexpected terminal"};
+		production.defined = true;
+		for (JSON_Token::KIND symbol: rhs)
+		{
+			if (symbol != JSON_Token::META_EPS)
+				production.rhs[production.count++] = symbol;
+		}
+	}
 
-		return productions.at(terminal);
+	constexpr const Production&
+	operator()(JSON_Token::KIND nonterminal, JSON_Token::KIND terminal) const
+	{
+		return table[nonterminal_index(nonterminal)][Compact_Token::compact_kind(terminal)];
 	}
 
-	Result<Production>
-	operator()(const JSON_Token& nonterminal, const JSON_Token& terminal) const
+	static constexpr PTable
+	make()
 	{
-		return this->operator()(nonterminal.kind(), terminal.kind());
+		PTable ptable{};
+		JSON_Token::fill_ptable(ptable);
+		return ptable;
 	}
 };
 
-PTable&
-JSON_PTable()
+constexpr void
+JSON_Token::fill_ptable(PTable& ptable)
 {
-	static PTable* ptable = nullptr;
-	if (ptable == nullptr)
-	{
-		static PTable _table{};
-		ptable = &_table;
-		JSON_Token::fill_ptable(*ptable);
-	}
-	return *ptable;
+	ptable.add(META_START, T_null, {N_V});
+	ptable.add(META_START, T_true, {N_V});
+	ptable.add(META_START, T_false, {N_V});
+	ptable.add(META_START, T_number, {N_V});
+	ptable.add(META_START, T_string, {N_V});
+	ptable.add(META_START, T_lbracket, {N_V});
+	ptable.add(META_START, T_lbrace, {N_V});
+
+	ptable.add(N_V, T_null, {T_null});
+	ptable.add(N_V, T_true, {T_true});
+	ptable.add(N_V, T_false, {T_false});
+	ptable.add(N_V, T_number, {T_number});
+	ptable.add(N_V, T_string, {T_string});
+	ptable.add(N_V, T_lbracket, {N_ARRAY});
+	ptable.add(N_V, T_lbrace, {N_OBJECT});
+
+	// Object
+	ptable.add(N_OBJECT, T_lbrace, {T_lbrace, N_MEMBERS, T_rbrace});
+
+	ptable.add(N_MEMBERS, T_string, {T_string, T_colon, N_V, N_MORE_MEMBERS});
+	ptable.add(N_MEMBERS, T_rbrace, {META_EPS});
+
+	ptable.add(N_MORE_MEMBERS, T_rbrace, {META_EPS});
+	ptable.add(N_MORE_MEMBERS, T_comma, {T_comma, T_string, T_colon, N_V, N_MORE_MEMBERS});
+
+	// Array
+	ptable.add(N_ARRAY, T_lbracket, {T_lbracket, N_ELEMENTS, T_rbracket});
+
+	ptable.add(N_ELEMENTS, T_lbracket, {N_V, N_MORE_ELEMENTS});
+	ptable.add(N_ELEMENTS, T_lbrace, {N_V, N_MORE_ELEMENTS});
+	ptable.add(N_ELEMENTS, T_string, {N_V, N_MORE_ELEMENTS});
+	ptable.add(N_ELEMENTS, T_number, {N_V, N_MORE_ELEMENTS});
+	ptable.add(N_ELEMENTS, T_true, {N_V, N_MORE_ELEMENTS});
+	ptable.add(N_ELEMENTS, T_false, {N_V, N_MORE_ELEMENTS});
+	ptable.add(N_ELEMENTS, T_null, {N_V, N_MORE_ELEMENTS});
+	ptable.add(N_ELEMENTS, T_rbracket, {META_EPS});
+
+	ptable.add(N_MORE_ELEMENTS, T_rbracket, {META_EPS});
+	ptable.add(N_MORE_ELEMENTS, T_comma, {T_comma, N_V, N_MORE_ELEMENTS});
 }
 
-struct JSON_Builder
+constexpr PTable JSON_PTABLE = PTable::make();
+
+static inline void
+mul_128(uint64_t a, uint64_t b, uint64_t& hi, uint64_t& lo)
 {
-	struct Context
-	{
-		J_JSON json;
-		std::vector<J_JSON> array_builder;
-		std::vector<J_Pair> object_builder;
+#if defined(_MSC_VER) && defined(_M_X64)
+	lo = _umul128(a, b, &hi);
+#elif defined(__SIZEOF_INT128__)
+	unsigned __int128 r = (unsigned __int128)a * b;
+	hi = uint64_t(r >> 64);
+	lo = uint64_t(r);
+#else
+	uint64_t a_lo = uint32_t(a), a_hi = a >> 32;
+	uint64_t b_lo = uint32_t(b), b_hi = b >> 32;
+	uint64_t lo_lo = a_lo * b_lo;
+	uint64_t hi_lo = a_hi * b_lo;
+	uint64_t lo_hi = a_lo * b_hi;
+	uint64_t cross = (lo_lo >> 32) + uint32_t(hi_lo) + lo_hi;
+	hi = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+	lo = (cross << 32) | uint32_t(lo_lo);
+#endif
+}
+
+// Decimal to double conversion of number tokens, allocation free and independent of the C locale
+// Tries, in order: integers that fit in 64 bits, Clinger's fast path, Eisel-Lemire, and std::from_chars
+// when more than 19 significant digits leave Eisel-Lemire undecided
+struct Number
+{
+	String_View text;
+	bool negative;
+	bool truncated;    // More than 19 significant digits, `mantissa` holds the first 19
+	uint64_t mantissa;
+	int64_t exponent;  // |value| = mantissa * 10^exponent (when not truncated)
+
+	static constexpr int MAX_DIGITS = 19;
+	static constexpr double POWERS_OF_TEN[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
 	};
-	std::stack<Context> _context;
 
-	JSON_Builder() : _context{}
+	// `text` must be a number token, its grammar is already checked by the lexer
+	static Number
+	parse(String_View text)
 	{
-		_context.push(Context{});
-	}
+		Number n{.text = text};
+		const char* it = text.ptr;
+		const char* end = text.ptr + text.count;
 
-	J_JSON
-	yield()
-	{
-		return _context.top().json;
-	}
+		n.negative = (*it == '-');
+		it += n.negative;
 
-	void
-	set_json(J_JSON json)
-	{
-		auto& ctx = _context.top();
-		if (ctx.json.kind == J_JSON_ARRAY) // build array
-		{
-			ctx.array_builder.push_back(json);
-		}
-		else if (ctx.json.kind == J_JSON_OBJECT)
+		// Leading zeros (only in "0.000ddd") don't count towards the significant digits
+		int digits = 0;
+		for (; it != end && *it >= '0' && *it <= '9'; it++)
 		{
-			if (ctx.object_builder.back().key)
+			if (digits < MAX_DIGITS)
 			{
-				ctx.object_builder.back().value = json;
-				ctx.object_builder.push_back({});
+				n.mantissa = n.mantissa * 10 + (*it - '0');
+				digits += (n.mantissa != 0);
 			}
 			else
 			{
-				assert(json.kind == J_JSON_STRING);
-				ctx.object_builder.back().key = json.as_string;
+				n.exponent++;
+				n.truncated |= (*it != '0');
 			}
 		}
-		else
+
+		if (it != end && *it == '.')
 		{
-			ctx.json = json;
+			for (it++; it != end && *it >= '0' && *it <= '9'; it++)
+			{
+				if (digits < MAX_DIGITS)
+				{
+					n.mantissa = n.mantissa * 10 + (*it - '0');
+					n.exponent--;
+					digits += (n.mantissa != 0);
+				}
+				else
+				{
+					n.truncated |= (*it != '0');
+				}
+			}
 		}
-	}
 
-	void
-	token(const JSON_Token& tkn)
-	{
-		switch (tkn.kind())
+		if (it != end && (*it == 'e' || *it == 'E'))
 		{
-		case JSON_Token::T_null:
-			return set_json({.kind = J_JSON_NULL});
+			it++;
+			bool negative_exponent = (*it == '-');
+			it += (*it == '-' || *it == '+');
+
+			// Saturate, anything this large is out of range anyway
+			int64_t e = 0;
+			for (; it != end; it++)
+				if (e < 0x10000)
+					e = e * 10 + (*it - '0');
+			n.exponent += negative_exponent ? -e : e;
+		}
 
-		case JSON_Token::T_true:
-			return set_json({.kind = J_JSON_BOOL, .as_bool = true});
+		return n;
+	}
 
-		case JSON_Token::T_false:
-			return set_json({.kind = J_JSON_BOOL, .as_bool = false});
+	double
+	to_double() const
+	{
+		ZoneScoped;
 
-		case JSON_Token::T_number: {
-			const char* tmp_str = tkn.data().cstr_new();
-			set_json({.kind = J_JSON_NUMBER, .as_number = ::atof(tmp_str)});
-			return ::free((void*)tmp_str);
+		double value;
+		if (truncated == false && exponent == 0)
+		{
+			// Integer to double conversion is correctly rounded
+			value = double(mantissa);
+		}
+#if FLT_EVAL_METHOD == 0
+		else if (truncated == false && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+		{
+			// Clinger: both operands are exact doubles, so a single rounding gives the exact result
+			value = double(mantissa);
+			value = exponent < 0 ? value / POWERS_OF_TEN[-exponent] : value * POWERS_OF_TEN[exponent];
+		}
+#endif
+		else if (truncated == false)
+		{
+			value = eisel_lemire(mantissa, exponent);
+		}
+		else
+		{
+			// The exact value lies in (mantissa, mantissa + 1) * 10^exponent
+			value = eisel_lemire(mantissa, exponent);
+			if (value != eisel_lemire(mantissa + 1, exponent))
+			{
+				auto [_, ec] = std::from_chars(text.ptr, text.ptr + text.count, value);
+				if (ec == std::errc::result_out_of_range)
+					value = exponent > 0 ? HUGE_VAL : 0.0;
+				else
+					return value;
+			}
 		}
+		return negative ? -value : value;
+	}
 
-		case JSON_Token::T_string:
-			return set_json({.kind = J_JSON_STRING, .as_string = tkn.data().cstr_new()});
+	// Exact, fails for fractions and integers out of range
+	bool
+	to_int64(int64_t& value) const
+	{
+		if (truncated)
+			return false;
 
-		case JSON_Token::T_lbracket:
-			return _context.push(Context{.json{J_JSON_ARRAY}});
+		uint64_t magnitude = mantissa;
+		for (int64_t e = exponent; e < 0 && magnitude != 0; e++)
+		{
+			if (magnitude % 10 != 0)
+				return false;
+			magnitude /= 10;
+		}
+		for (int64_t e = exponent; e > 0 && magnitude != 0; e--)
+		{
+			if (magnitude > UINT64_MAX / 10)
+				return false;
+			magnitude *= 10;
+		}
 
-		case JSON_Token::T_lbrace:
-			_context.push(Context{.json{J_JSON_OBJECT}});
-			return _context.top().object_builder.push_back({}); // dummy
+		if (magnitude > uint64_t(INT64_MAX) + negative)
+			return false;
+		value = negative ? int64_t(0 - magnitude) : int64_t(magnitude);
+		return true;
+	}
 
-		case JSON_Token::T_rbracket:
-		case JSON_Token::T_rbrace: {
-			auto last_ctx = std::move(_context.top());
-			if (last_ctx.json.kind == J_JSON_ARRAY)
-			{
-				assert(last_ctx.object_builder.empty());
-				size_t sz = last_ctx.array_builder.size() * sizeof(J_JSON);
-				last_ctx.json.as_array = {
-					.ptr = (J_JSON*)::malloc(sz),
-					.count = last_ctx.array_builder.size()
-				};
-				::memcpy(last_ctx.json.as_array.ptr, last_ctx.array_builder.data(), sz);
-			}
-			else if (last_ctx.json.kind == J_JSON_OBJECT)
-			{
-				assert(last_ctx.array_builder.empty());
-				assert(last_ctx.object_builder.back().key == nullptr);
-				last_ctx.object_builder.pop_back();
-
-				size_t sz = last_ctx.object_builder.size() * sizeof(J_Pair);
-				last_ctx.json.as_object = {
-					.pairs = (J_Pair*)::malloc(sz),
-					.count = last_ctx.object_builder.size()
-				};
-				::memcpy(last_ctx.json.as_object.pairs, last_ctx.object_builder.data(), sz);
-			}
+	// Eisel-Lemire: the upper bits of w * 5^q (with a 128-bit approximation of 5^q) decide the rounding
+	// of w * 10^q for any 64-bit w, see "Number Parsing at a Gigabyte per Second" (Lemire, 2021)
+	static double
+	eisel_lemire(uint64_t w, int64_t q)
+	{
+		if (w == 0 || q < POWERS_OF_FIVE_MIN)
+			return 0.0;
+		if (q > POWERS_OF_FIVE_MAX)
+			return HUGE_VAL;
+
+		int lz = std::countl_zero(w);
+		w <<= lz;
+
+		// 52 explicit mantissa bits + the implicit bit + a rounding bit + the product's possible leading zero
+		// Only when the 9 bits below those are all ones can the lower word of 5^q change the result
+		const uint64_t* power = &POWERS_OF_FIVE[2 * (q - POWERS_OF_FIVE_MIN)];
+		uint64_t hi, lo;
+		mul_128(w, power[0], hi, lo);
+		if ((hi & 0x1FF) == 0x1FF)
+		{
+			uint64_t second_hi, second_lo;
+			mul_128(w, power[1], second_hi, second_lo);
+			lo += second_hi;
+			hi += (lo < second_hi);
+		}
 
-			_context.pop();
-			set_json(last_ctx.json);
+		int upperbit = int(hi >> 63);
+		uint64_t mantissa = hi >> (upperbit + 9);
+		// floor(log2(10^q)) + 63, biased
+		int64_t power2 = ((217706 * q) >> 16) + 63 + upperbit - lz + 1023;
+
+		if (power2 <= 0)
+		{
+			// Subnormal, or rounds up to the smallest normal
+			if (-power2 + 1 >= 64)
+				return 0.0;
+			mantissa >>= -power2 + 1;
+			mantissa += (mantissa & 1);
+			mantissa >>= 1;
+			power2 = mantissa < (uint64_t(1) << 52) ? 0 : 1;
+			return std::bit_cast<double>((uint64_t(power2) << 52) | mantissa);
 		}
 
-		default: break;
+		// Exactly halfway between two doubles, round to even; only possible for small powers
+		if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << (upperbit + 9)) == hi)
+			mantissa &= ~uint64_t(1);
+
+		mantissa += (mantissa & 1);
+		mantissa >>= 1;
+		if (mantissa >= (uint64_t(2) << 52))
+		{
+			mantissa = uint64_t(1) << 52;
+			power2++;
 		}
+		mantissa &= ~(uint64_t(1) << 52);
+
+		if (power2 >= 0x7FF)
+			return HUGE_VAL;
+		return std::bit_cast<double>((uint64_t(power2) << 52) | mantissa);
 	}
 };
 
-struct Parser
+// Bump allocator behind J_Document: every node, pair block and string of one document is carved
+// out of a few large chunks, which are all released together
+struct Arena
 {
-	std::span<JSON_Token> _tokens;
-	std::span<JSON_Token>::iterator _it;
-	PTable& _ptable{JSON_PTable()};
+	struct Chunk
+	{
+		Chunk* next;
+	};
+
+	static constexpr size_t ALIGNMENT = alignof(J_JSON);
+	static constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+	static constexpr size_t MAX_CHUNK_SIZE = 64 * 1024 * 1024;
 
-	Parser() = default;
-	Parser(std::span<JSON_Token> tokens) : _tokens(tokens), _it(_tokens.begin()), _ptable(JSON_PTable()) {}
+	Chunk* _chunks;
+	char* _cursor;
+	char* _end;
+	size_t _chunk_size; // of the next chunk, doubles up to MAX_CHUNK_SIZE
+	std::atomic<Chunk*> _adopted; // malloc'd elsewhere once the document was built, see `adopt`
 
-	Result<J_JSON>
-	parse()
+	Arena() : _chunks(nullptr), _cursor(nullptr), _end(nullptr), _chunk_size(MIN_CHUNK_SIZE), _adopted(nullptr)
 	{
-		ZoneScoped;
+	}
 
-		std::stack<JSON_Token> stack{};
-		stack.emplace(JSON_Token::META_START);
+	Arena(const Arena&) = delete;
 
-		JSON_Builder builder{};
+	Arena&
+	operator=(const Arena&) = delete;
 
-		while (stack.empty() == false)
+	~Arena()
+	{
+		free_adopted();
+		while (_chunks)
 		{
-			JSON_Token input_terminal = *_it;
-			if (input_terminal.is_equal(stack.top()))
-			{
-				stack.pop();
-				builder.token(input_terminal);
+			Chunk* next = _chunks->next;
+			::free(_chunks);
+			_chunks = next;
+		}
+	}
 
-				_it++;
-				if (_it == _tokens.end()) return Error{"Incomplete"};
-			}
-			else if (stack.top().is_terminal())
-			{
-				return Error{"Unexpected terminal"};
-			}
-			else if (auto [production, err] = _ptable(stack.top(), input_terminal); err)
-			{
-				return err;
-			}
-			else
+	// Hands a malloc'd block that starts with a Chunk over to the arena, which frees it along with
+	// its own. Readers of a finished document may call this from several threads at once.
+	void
+	adopt(Chunk* chunk)
+	{
+		chunk->next = _adopted.load(std::memory_order_relaxed);
+		while (_adopted.compare_exchange_weak(chunk->next, chunk, std::memory_order_release, std::memory_order_relaxed) == false)
+		{
+		}
+	}
+
+	void
+	free_adopted()
+	{
+		Chunk* chunk = _adopted.exchange(nullptr, std::memory_order_acquire);
+		while (chunk)
+		{
+			Chunk* next = chunk->next;
+			::free(chunk);
+			chunk = next;
+		}
+	}
+
+	static constexpr size_t
+	align(size_t size)
+	{
+		return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	inline void*
+	allocate(size_t size)
+	{
+		size = align(size);
+		if (size > size_t(_end - _cursor))
+			return allocate_slow(size);
+
+		void* ptr = _cursor;
+		_cursor += size;
+		return ptr;
+	}
+
+	// Frees every block but keeps the current chunk for reuse
+	void
+	reset()
+	{
+		free_adopted();
+		if (_chunks == nullptr)
+			return;
+
+		while (Chunk* next = _chunks->next)
+		{
+			_chunks->next = next->next;
+			::free(next);
+		}
+		_cursor = (char*)(_chunks + 1);
+	}
+
+	// Gives back the end of the latest allocation, which was `size` bytes and now needs `used`
+	inline void
+	shrink(void* ptr, size_t size, size_t used)
+	{
+		if ((char*)ptr + align(size) == _cursor)
+			_cursor = (char*)ptr + align(used);
+	}
+
+	void*
+	allocate_slow(size_t size)
+	{
+		if (size > _chunk_size / 4)
+		{
+			// Large blocks get a chunk of their own behind the current one, which stays open
+			Chunk* chunk = (Chunk*)j_malloc(sizeof(Chunk) + size);
+			if (_chunks)
 			{
-				stack.pop();
-				for (auto rhs = production.rhs.rbegin(); rhs != production.rhs.rend(); rhs++)
-				{
-					if (rhs->kind() != JSON_Token::META_EPS)
-						stack.push(*rhs);
-				}
+				chunk->next = _chunks->next;
+				_chunks->next = chunk;
+			}
+			else
+			{
+				chunk->next = nullptr;
+				_chunks = chunk;
 			}
+			return chunk + 1;
 		}
 
-		if (_it->is_equal(JSON_Token::META_END_OF_INPUT) == false)
-			return Error{"Trailing characters"};
-		assert(_it + 1 == _tokens.end());
+		Chunk* chunk = (Chunk*)j_malloc(sizeof(Chunk) + _chunk_size);
+		chunk->next = _chunks;
+		_chunks = chunk;
+		_cursor = (char*)(chunk + 1);
+		_end = _cursor + _chunk_size;
+		_chunk_size = std::min(_chunk_size * 2, MAX_CHUNK_SIZE);
 
-		return builder.yield();
+		void* ptr = _cursor;
+		_cursor += size;
+		return ptr;
 	}
 };
+static_assert(sizeof(Arena::Chunk) % Arena::ALIGNMENT == 0);
 
-struct Lexer
+// Decoded object keys of a document by their text, so that equal keys share one string. Keys with
+// escapes aren't interned: the raw text of the others is their decoded text, which is what
+// JSON_Builder looks up before decoding anything.
+struct Key_Interner
 {
-	std::string_view _string;
+	static constexpr size_t MAX_KEY_SIZE = 256;
+	static constexpr size_t MAX_COUNT = 64 * 1024; // documents with more keys than this rarely repeat them
 
-	enum STATE
+	struct Slot
 	{
-		STATE_0,
+		uint64_t hash;
+		const char* key; // null when empty
+		size_t count;
+	};
 
-		STATE_T,
-		STATE_TR,
-		STATE_TRU,
+	Slot* _slots;
+	size_t _capacity; // a power of two, kept at most half full
+	size_t _count;
 
-		STATE_F,
-		STATE_FA,
-		STATE_FAL,
-		STATE_FALS,
+	Key_Interner() : _slots(nullptr), _capacity(0), _count(0)
+	{
+	}
 
-		STATE_N,
-		STATE_NU,
-		STATE_NUL,
+	Key_Interner(const Key_Interner&) = delete;
 
-		STATE_NUMBER_MINUS,
-		STATE_NUMBER_INTEGER,
-		STATE_NUMBER_INTEGER_LEADING_ZERO,
-		STATE_NUMBER_FRACTION,
-		STATE_NUMBER_FRACTION_DIGITS,
-		STATE_NUMBER_EXPONENT,
-		STATE_NUMBER_EXPONENT_SIGN,
-		STATE_NUMBER_EXPONENT_DIGITS,
+	Key_Interner&
+	operator=(const Key_Interner&) = delete;
 
-		STATE_u,
-		STATE_uX,
-		STATE_uXX,
-		STATE_uXXX,
-		STATE_uXXXX,
+	~Key_Interner()
+	{
+		::free(_slots);
+	}
 
-		STATE_STRING,
-		STATE_BACKSLASH,
+	void
+	swap(Key_Interner& other)
+	{
+		std::swap(_slots, other._slots);
+		std::swap(_capacity, other._capacity);
+		std::swap(_count, other._count);
+	}
+
+	void
+	clear()
+	{
+		if (_count > 0)
+			::memset(_slots, 0, _capacity * sizeof(Slot));
+		_count = 0;
+	}
+
+	static inline uint64_t
+	hash(const char* key, size_t count)
+	{
+		constexpr uint64_t K = 0x9E3779B97F4A7C15;
+
+		uint64_t h = count * K;
+		for (; count >= 8; key += 8, count -= 8)
+		{
+			uint64_t word;
+			::memcpy(&word, key, 8);
+			h = (h ^ word) * K;
+			h ^= h >> 29;
+		}
+		if (count > 0)
+		{
+			uint64_t word = 0;
+			::memcpy(&word, key, count);
+			h = (h ^ word) * K;
+			h ^= h >> 29;
+		}
+		return h;
+	}
+
+	inline const char*
+	find(const char* key, size_t count, uint64_t hash) const
+	{
+		if (_count == 0)
+			return nullptr;
+
+		for (size_t i = hash & (_capacity - 1);; i = (i + 1) & (_capacity - 1))
+		{
+			const Slot& slot = _slots[i];
+			if (slot.key == nullptr)
+				return nullptr;
+			if (slot.hash == hash && slot.count == count && ::memcmp(slot.key, key, count) == 0)
+				return slot.key;
+		}
+	}
+
+	// `key` must not be in the table yet, and must outlive it
+	void
+	insert(const char* key, size_t count, uint64_t hash)
+	{
+		if (_count == MAX_COUNT)
+			return;
+
+		if (2 * (_count + 1) > _capacity)
+		{
+			Slot* old_slots = _slots;
+			size_t old_capacity = _capacity;
+
+			_capacity = _capacity ? _capacity * 2 : 64;
+			_slots = (Slot*)j_malloc(_capacity * sizeof(Slot));
+			::memset(_slots, 0, _capacity * sizeof(Slot));
+			_count = 0;
+			for (size_t i = 0; i < old_capacity; i++)
+				if (old_slots[i].key)
+					insert(old_slots[i].key, old_slots[i].count, old_slots[i].hash);
+			::free(old_slots);
+		}
+
+		size_t i = hash & (_capacity - 1);
+		while (_slots[i].key)
+			i = (i + 1) & (_capacity - 1);
+		_slots[i] = Slot{hash, key, count};
+		_count++;
+	}
+};
+
+struct J_Document
+{
+	Arena arena;
+	Key_Interner keys;
+};
+
+// Every string of a document is decoded into shared chunks instead of an allocation of its own.
+// Strings are preceded by a header pointing back to their chunk, so that j_free can still release
+// any subtree by itself: a chunk is freed along with the last of its strings. Strings of a
+// J_Document are bump allocated from its arena instead, and have no chunk.
+struct String_Arena
+{
+	struct Chunk
+	{
+		size_t refs; // one per string, plus one for the arena while it writes to the chunk
 	};
 
-	std::stack<STATE> _state_stack;
-	std::vector<JSON_Token> _tokens;
-	String_View _terminal_builder;
+	struct Header
+	{
+		Chunk* chunk;
+		size_t count; // decoded size in bytes, "\u0000" makes it differ from strlen
+	};
 
-	Lexer() = default;
-	Lexer(std::string_view string) : _string(string), _state_stack{}, _tokens{}, _terminal_builder{}
+	static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+	Chunk* _chunk;
+	char* _cursor;
+	char* _end;
+	Arena* _document;
+
+	String_Arena(Arena* document) : _chunk(nullptr), _cursor(nullptr), _end(nullptr), _document(document)
 	{
-		_state_stack.push(STATE_0);
 	}
 
-	inline bool
-	is_whitespace(Rune rune)
+	String_Arena(const String_Arena&) = delete;
+
+	String_Arena&
+	operator=(const String_Arena&) = delete;
+
+	~String_Arena()
+	{
+		if (_chunk)
+			unref(_chunk);
+	}
+
+	static inline void
+	unref(Chunk* chunk)
+	{
+		if (--chunk->refs == 0)
+			::free(chunk);
+	}
+
+	static inline Header*
+	header(const char* string)
+	{
+		return (Header*)string - 1;
+	}
+
+	// Takes one more reference to a decoded string, each one is given back by `release`
+	static inline void
+	retain(const char* string)
+	{
+		if (Chunk* chunk = header(string)->chunk)
+			chunk->refs++;
+	}
+
+	static inline void
+	release(const char* string)
+	{
+		if (Chunk* chunk = header(string)->chunk)
+			unref(chunk);
+	}
+
+	// Decodes the body of a string token, which the lexer already validated
+	const char*
+	decode(String_View raw)
 	{
-		switch (rune)
+		ZoneScoped;
+
+		// Decoding never makes a string longer
+		size_t capacity = sizeof(Header) + raw.count + 1;
+
+		if (_document)
 		{
-		case 0x20: case 0x0a: case 0x0d: case 0x09:
-			return true;
-		default:
-			return false;
+			char* out = (char*)_document->allocate(capacity);
+			char* string = out + sizeof(Header);
+			size_t count = unescape(raw, string);
+			string[count] = '\0';
+
+			*(Header*)out = Header{nullptr, count};
+			_document->shrink(out, capacity, sizeof(Header) + count + 1);
+			return string;
+		}
+
+		Chunk* chunk = _chunk;
+		char* out = _cursor;
+		if (capacity > size_t(_end - _cursor))
+		{
+			if (capacity > CHUNK_SIZE / 4)
+			{
+				// Large strings get a chunk of their own, the current one stays open
+				chunk = (Chunk*)j_malloc(sizeof(Chunk) + capacity);
+				chunk->refs = 0;
+				out = (char*)(chunk + 1);
+			}
+			else
+			{
+				if (_chunk)
+					unref(_chunk);
+				_chunk = chunk = (Chunk*)j_malloc(sizeof(Chunk) + CHUNK_SIZE);
+				_chunk->refs = 1;
+				_cursor = out = (char*)(_chunk + 1);
+				_end = _cursor + CHUNK_SIZE;
+			}
+		}
+
+		char* string = out + sizeof(Header);
+		size_t count = unescape(raw, string);
+		string[count] = '\0';
+
+		*(Header*)out = Header{chunk, count};
+		chunk->refs++;
+
+		if (chunk == _chunk)
+		{
+			size_t used = sizeof(Header) + count + 1;
+			_cursor += (used + alignof(Header) - 1) & ~(alignof(Header) - 1);
 		}
+		return string;
 	}
 
-	inline bool
-	is_digit(Rune rune)
+	static inline uint32_t
+	hex4(const char* it)
 	{
-		return Rune('0') <= rune && rune <= Rune('9');
+		uint32_t value = 0;
+		for (size_t i = 0; i < 4; i++)
+		{
+			char c = it[i];
+			value = value * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+		}
+		return value;
 	}
 
-	inline bool
-	is_hexdigit(Rune rune)
+	static inline char*
+	encode_utf8(uint32_t codepoint, char* out)
 	{
-		return is_digit(rune) || (Rune('a') <= rune && rune <= Rune('f')) || (Rune('A') <= rune && rune <= Rune('F'));
+		if (codepoint < 0x80)
+		{
+			*out++ = char(codepoint);
+		}
+		else if (codepoint < 0x800)
+		{
+			*out++ = char(0xC0 | (codepoint >> 6));
+			*out++ = char(0x80 | (codepoint & 0x3F));
+		}
+		else if (codepoint < 0x10000)
+		{
+			*out++ = char(0xE0 | (codepoint >> 12));
+			*out++ = char(0x80 | ((codepoint >> 6) & 0x3F));
+			*out++ = char(0x80 | (codepoint & 0x3F));
+		}
+		else
+		{
+			*out++ = char(0xF0 | (codepoint >> 18));
+			*out++ = char(0x80 | ((codepoint >> 12) & 0x3F));
+			*out++ = char(0x80 | ((codepoint >> 6) & 0x3F));
+			*out++ = char(0x80 | (codepoint & 0x3F));
+		}
+		return out;
 	}
 
-	inline bool
-	is_singlechar_terminal(Rune rune)
+	// Copies the spans between backslashes a vector at a time and decodes the escapes, returns the
+	// decoded size. Surrogate pairs are combined, lone surrogates become U+FFFD.
+	static size_t
+	unescape(String_View raw, char* out)
 	{
-		switch (rune)
+		const char* it = raw.ptr;
+		const char* end = raw.ptr + raw.count;
+		char* begin = out;
+
+		while (true)
 		{
-		case JSON_Token::T_comma:
-		case JSON_Token::T_lbracket:
-		case JSON_Token::T_rbracket:
-		case JSON_Token::T_lbrace:
-		case JSON_Token::T_rbrace:
-		case JSON_Token::T_colon:
-		case JSON_Token::T_backslash:
-			return true;
-		default:
-			return false;
+			// Whole vectors are stored before looking for a backslash in them, the output never
+			// gets ahead of the input so this stays within the string's capacity
+#if defined(__AVX2__)
+			for (; end - it >= 32; it += 32, out += 32)
+			{
+				__m256i v = _mm256_loadu_si256((const __m256i*)it);
+				_mm256_storeu_si256((__m256i*)out, v);
+				if (uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))))
+				{
+					it += std::countr_zero(mask);
+					out += std::countr_zero(mask);
+					goto escape;
+				}
+			}
+#endif
+#if JSON_PARSER_SSE2
+			for (; end - it >= 16; it += 16, out += 16)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i*)it);
+				_mm_storeu_si128((__m128i*)out, v);
+				if (uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))))
+				{
+					it += std::countr_zero(mask);
+					out += std::countr_zero(mask);
+					goto escape;
+				}
+			}
+#endif
+			if (const char* backslash = (const char*)::memchr(it, '\\', end - it))
+			{
+				::memcpy(out, it, backslash - it);
+				out += backslash - it;
+				it = backslash;
+			}
+			else
+			{
+				::memcpy(out, it, end - it);
+				return (out + (end - it)) - begin;
+			}
+
+		escape:
+			switch (it[1])
+			{
+			case 'b': *out++ = '\b'; it += 2; break;
+			case 'f': *out++ = '\f'; it += 2; break;
+			case 'n': *out++ = '\n'; it += 2; break;
+			case 'r': *out++ = '\r'; it += 2; break;
+			case 't': *out++ = '\t'; it += 2; break;
+			case 'u': {
+				uint32_t codepoint = hex4(it + 2);
+				it += 6;
+				if (codepoint >= 0xD800 && codepoint <= 0xDBFF && end - it >= 6 && it[0] == '\\' && it[1] == 'u')
+				{
+					uint32_t low = hex4(it + 2);
+					if (low >= 0xDC00 && low <= 0xDFFF)
+					{
+						codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+						it += 6;
+					}
+				}
+				if (codepoint >= 0xD800 && codepoint <= 0xDFFF)
+					codepoint = 0xFFFD;
+				out = encode_utf8(codepoint, out);
+				break;
+			}
+			default: // " \ /
+				*out++ = it[1];
+				it += 2;
+				break;
+			}
 		}
 	}
+};
+
+// Open containers collect their children on one scratch stack shared by every nesting level, in
+// place of a pair of vectors each. A closing container copies its children out into a block of
+// their exact size and pops them, which leaves the scratch space to its parent.
+// Objects with at least OBJECT_INDEX_MIN_COUNT pairs have an Object_Header in front of their pairs,
+// where j_object_get keeps the hash index it builds on their first lookup. Smaller objects are
+// scanned instead.
+static constexpr size_t OBJECT_INDEX_MIN_COUNT = 16;
+
+struct Object_Index
+{
+	Arena::Chunk link; // for Arena::adopt
+	size_t mask;
+
+	// One per slot: the top 32 bits of the key's hash and the pair's index + 1, 0 when empty
+	uint64_t*
+	slots()
+	{
+		return (uint64_t*)(this + 1);
+	}
 
-	inline Result<bool>
-	try_to_scan_singlechar_terminal(String_View str, Rune rune)
+	static inline uint64_t
+	rotl(uint64_t x, int bits)
 	{
-		ZoneScoped;
+		return (x << bits) | (x >> (64 - bits));
+	}
 
-		if (_state_stack.top() != STATE_0)
-			return false;
+	// SipHash-1-3 keyed with a random key per process, so that keys can't be picked to collide
+	static uint64_t
+	hash(const char* data, size_t size)
+	{
+		static const std::array<uint64_t, 2> KEY = [] {
+			std::random_device device;
+			return std::array<uint64_t, 2>{
+				(uint64_t(device()) << 32) | device(),
+				(uint64_t(device()) << 32) | device()};
+		}();
+
+		uint64_t v0 = 0x736f6d6570736575 ^ KEY[0];
+		uint64_t v1 = 0x646f72616e646f6d ^ KEY[1];
+		uint64_t v2 = 0x6c7967656e657261 ^ KEY[0];
+		uint64_t v3 = 0x7465646279746573 ^ KEY[1];
+		auto round = [&] {
+			v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+			v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+			v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+			v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+		};
 
-		if (is_whitespace(rune)) // skip whitespace
-			return true;
+		const char* end = data + (size & ~size_t(7));
+		for (; data != end; data += 8)
+		{
+			uint64_t m;
+			::memcpy(&m, data, 8);
+			v3 ^= m;
+			round();
+			v0 ^= m;
+		}
+
+		uint64_t m = uint64_t(size) << 56;
+		uint64_t tail = 0;
+		::memcpy(&tail, data, size & 7);
+		m |= tail;
+		v3 ^= m;
+		round();
+		v0 ^= m;
+
+		v2 ^= 0xff;
+		round();
+		round();
+		round();
+		return v0 ^ v1 ^ v2 ^ v3;
+	}
 
-		if (is_digit(rune))
-			unreachable("Found a digit");
+	static inline bool
+	key_equal(J_String a, const char* b, size_t size)
+	{
+		return String_Arena::header(a)->count == size && ::memcmp(a, b, size) == 0;
+	}
 
-		if (rune == '"')
+	// Slot of `key`, or of the empty slot where it would go
+	inline uint64_t*
+	find(const J_Pair* pairs, const char* key, size_t size, uint64_t hash)
+	{
+		uint64_t tag = hash >> 32;
+		for (size_t i = hash & mask;; i = (i + 1) & mask)
 		{
-			_state_stack.push(STATE_STRING);
-			return true;
+			uint64_t* slot = slots() + i;
+			if (*slot == 0)
+				return slot;
+			if ((*slot >> 32) == tag && key_equal(pairs[uint32_t(*slot) - 1].key, key, size))
+				return slot;
 		}
+	}
+
+	// Duplicate keys keep their first pair, like a scan would
+	static Object_Index*
+	build(J_Object object)
+	{
+		size_t capacity = std::bit_ceil(2 * object.count);
+		Object_Index* index = (Object_Index*)j_malloc(sizeof(Object_Index) + capacity * sizeof(uint64_t));
+		index->mask = capacity - 1;
+		::memset(index->slots(), 0, capacity * sizeof(uint64_t));
 
-		if (is_singlechar_terminal(rune))
+		for (size_t i = 0; i < object.count; i++)
 		{
-			_tokens.emplace_back(rune);
-			return true;
+			J_String key = object.pairs[i].key;
+			size_t size = String_Arena::header(key)->count;
+			uint64_t hash = Object_Index::hash(key, size);
+			uint64_t* slot = index->find(object.pairs, key, size, hash);
+			if (*slot == 0)
+				*slot = (hash >> 32 << 32) | (i + 1);
 		}
+		return index;
+	}
+};
+
+struct Object_Header
+{
+	std::atomic<Object_Index*> index;
+	Arena* document; // owns the index once built, null if the object was malloc'd
+};
+static_assert(sizeof(Object_Header) % alignof(J_Pair) == 0);
+
+static inline Object_Header*
+_j_object_header(J_Object object)
+{
+	assert(object.count >= OBJECT_INDEX_MIN_COUNT);
+	return (Object_Header*)object.pairs - 1;
+}
+
+// Pair block for an object of `count` pairs, from `document` or malloc'd when null
+static J_Pair*
+_j_allocate_pairs(size_t count, Arena* document)
+{
+	size_t size = count * sizeof(J_Pair);
+	if (count < OBJECT_INDEX_MIN_COUNT)
+		return (J_Pair*)(document ? document->allocate(size) : j_malloc(size));
+
+	size += sizeof(Object_Header);
+	auto header = (Object_Header*)(document ? document->allocate(size) : j_malloc(size));
+	new (header) Object_Header{{nullptr}, document};
+	return (J_Pair*)(header + 1);
+}
+
+// Frees the pair block of a malloc'd object, and its index
+static void
+_j_free_pairs(J_Object object)
+{
+	if (object.count < OBJECT_INDEX_MIN_COUNT)
+		return ::free(object.pairs);
+
+	Object_Header* header = _j_object_header(object);
+	::free(header->index.load(std::memory_order_acquire));
+	::free(header);
+}
+
+struct JSON_Builder
+{
+	struct Context
+	{
+		J_JSON json;
+		size_t begin; // first child in _children, objects push a key before each value
+	};
+	Fixed_Stack<Context> _context; // the top-level value, then one per open container
+	Scratch_Stack<J_JSON> _children;
+	String_Arena _strings;
+	Key_Interner _keys;
+	Arena* _document; // null when every block is malloc'd for j_free
+	J_Parse_Options _options;
+
+	JSON_Builder(const J_Parse_Options& options, Arena* document)
+		: _context{options.max_depth + 1}, _children{}, _strings{document}, _document(document), _options(options)
+	{
+		_context.push(Context{});
+	}
+
+	inline void*
+	allocate(size_t size)
+	{
+		return _document ? _document->allocate(size) : j_malloc(size);
+	}
+
+	// Readies the builder for another document in `document`, keeping the memory of its stacks.
+	// Interned keys are kept too, clear them unless they still live in `document`.
+	void
+	reset(Arena* document)
+	{
+		assert(document != nullptr && _strings._chunk == nullptr);
+
+		while (_context.empty() == false)
+			_context.pop();
+		_context.push(Context{});
+		_children.truncate(0);
+		_strings._document = document;
+		_document = document;
+	}
+
+	// A string token is a key when it opens a pair of the innermost object
+	inline bool
+	is_key()
+	{
+		const Context& ctx = _context.top();
+		return ctx.json.kind == J_JSON_OBJECT && (_children.size() - ctx.begin) % 2 == 0;
+	}
+
+	const char*
+	intern(String_View raw)
+	{
+		if (raw.count > Key_Interner::MAX_KEY_SIZE || ::memchr(raw.ptr, '\\', raw.count))
+			return _strings.decode(raw);
+
+		uint64_t hash = Key_Interner::hash(raw.ptr, raw.count);
+		if (const char* key = _keys.find(raw.ptr, raw.count, hash))
+		{
+			String_Arena::retain(key);
+			return key;
+		}
+
+		const char* key = _strings.decode(raw);
+		_keys.insert(key, raw.count, hash);
+		return key;
+	}
+
+	J_JSON
+	yield()
+	{
+		return _context.top().json;
+	}
+
+	void
+	set_json(J_JSON json)
+	{
+		if (_context.size() > 1)
+			_children.push(json);
+		else
+			_context.top().json = json;
+	}
+
+	J_JSON
+	close(Context ctx)
+	{
+		J_JSON* children = _children.data() + ctx.begin;
+		size_t count = _children.size() - ctx.begin;
+
+		if (ctx.json.kind == J_JSON_ARRAY)
+		{
+			ctx.json.as_array = {
+				.ptr = (J_JSON*)allocate(count * sizeof(J_JSON)),
+				.count = count
+			};
+			if (count > 0)
+				::memcpy(ctx.json.as_array.ptr, children, count * sizeof(J_JSON));
+		}
+		else
+		{
+			assert(count % 2 == 0);
+			ctx.json.as_object = {
+				.pairs = _j_allocate_pairs(count / 2, _document),
+				.count = count / 2
+			};
+			for (size_t i = 0; i < count / 2; i++)
+			{
+				assert(children[2 * i].kind == J_JSON_STRING);
+				ctx.json.as_object.pairs[i] = J_Pair{children[2 * i].as_string, children[2 * i + 1]};
+			}
+		}
+
+		_children.truncate(ctx.begin);
+		return ctx.json;
+	}
+
+	// Opening a container past J_Parse_Options.max_depth is the only error
+	Error
+	token(const JSON_Token& tkn)
+	{
+		switch (tkn.kind())
+		{
+		case JSON_Token::T_null:
+			set_json({.kind = J_JSON_NULL});
+			break;
+
+		case JSON_Token::T_true:
+			set_json({.kind = J_JSON_BOOL, .as_bool = true});
+			break;
+
+		case JSON_Token::T_false:
+			set_json({.kind = J_JSON_BOOL, .as_bool = false});
+			break;
+
+		case JSON_Token::T_number:
+			if (_options.lazy_numbers)
+			{
+				String_View text = tkn.data();
+				set_json({.kind = J_JSON_NUMBER, .flags = J_JSON_FLAG_NUMBER_TEXT, .as_number_text = {text.ptr, text.count}});
+				break;
+			}
+			set_json({.kind = J_JSON_NUMBER, .as_number = Number::parse(tkn.data()).to_double()});
+			break;
+
+		case JSON_Token::T_string:
+			set_json({.kind = J_JSON_STRING, .as_string = is_key() ? intern(tkn.data()) : _strings.decode(tkn.data())});
+			break;
+
+		case JSON_Token::T_lbracket:
+			if (_context.full())
+				return Error{"Nesting too deep"};
+			_context.push(Context{.json{J_JSON_ARRAY}, .begin = _children.size()});
+			break;
+
+		case JSON_Token::T_lbrace:
+			if (_context.full())
+				return Error{"Nesting too deep"};
+			_context.push(Context{.json{J_JSON_OBJECT}, .begin = _children.size()});
+			break;
+
+		case JSON_Token::T_rbracket:
+		case JSON_Token::T_rbrace: {
+			Context last_ctx = _context.top();
+			_context.pop();
+			set_json(close(last_ctx));
+			break;
+		}
+
+		default: break;
+		}
+		return Error{};
+	}
+};
+
+// A document as one contiguous array of tagged words in document order, see J_Tape in
+// json-parser.h. The tag is in the top byte of a word and its payload in the other 56 bits.
+struct J_Tape
+{
+	enum TAG : uint8_t
+	{
+		TAG_NULL         = 'n',
+		TAG_TRUE         = 't',
+		TAG_FALSE        = 'f',
+		TAG_NUMBER       = 'd', // the next word holds the double's bits
+		TAG_NUMBER_TEXT  = 'x', // payload is the text's size, the next word points at it
+		TAG_STRING       = 's', // payload points at the decoded string
+		TAG_ARRAY        = '[', // payload is the index right after the matching TAG_ARRAY_END
+		TAG_ARRAY_END    = ']', // payload is the element count
+		TAG_OBJECT       = '{', // payload is the index right after the matching TAG_OBJECT_END
+		TAG_OBJECT_END   = '}', // payload is the pair count
+	};
+
+	static constexpr uint64_t PAYLOAD_MASK = (uint64_t(1) << 56) - 1;
+
+	Arena arena; // strings
+	Scratch_Stack<uint64_t> words;
+
+	static inline uint64_t
+	word(TAG tag, uint64_t payload)
+	{
+		assert(payload <= PAYLOAD_MASK);
+		return (uint64_t(tag) << 56) | payload;
+	}
+
+	static inline TAG
+	tag(uint64_t word)
+	{
+		return TAG(word >> 56);
+	}
+
+	static inline uint64_t
+	payload(uint64_t word)
+	{
+		return word & PAYLOAD_MASK;
+	}
+
+	// Index of the value after the one at `index`, past its whole subtree
+	inline size_t
+	skip(size_t index) const
+	{
+		uint64_t w = words._items[index];
+		switch (tag(w))
+		{
+		case TAG_ARRAY:
+		case TAG_OBJECT:
+			return payload(w);
+
+		case TAG_NUMBER:
+		case TAG_NUMBER_TEXT:
+			return index + 2;
+
+		default:
+			return index + 1;
+		}
+	}
+};
+
+// Writes the document to a J_Tape instead of a tree of J_JSON. Each container's start word is
+// patched with its end's index once it closes, and its end word with its child count.
+struct Tape_Builder
+{
+	struct Open
+	{
+		size_t start;
+		size_t count; // keys and values both count for objects
+	};
+	Fixed_Stack<Open> _open;
+	J_Tape& _tape;
+	String_Arena _strings;
+	J_Parse_Options _options;
+
+	Tape_Builder(const J_Parse_Options& options, J_Tape& tape)
+		: _open{options.max_depth}, _tape(tape), _strings{&tape.arena}, _options(options)
+	{
+	}
+
+	inline void
+	push(J_Tape::TAG tag, uint64_t payload)
+	{
+		if (_open.empty() == false)
+			_open.top().count++;
+		_tape.words.push(J_Tape::word(tag, payload));
+	}
+
+	Error
+	token(const JSON_Token& tkn)
+	{
+		switch (tkn.kind())
+		{
+		case JSON_Token::T_null:
+			push(J_Tape::TAG_NULL, 0);
+			break;
+
+		case JSON_Token::T_true:
+			push(J_Tape::TAG_TRUE, 0);
+			break;
+
+		case JSON_Token::T_false:
+			push(J_Tape::TAG_FALSE, 0);
+			break;
+
+		case JSON_Token::T_number: {
+			String_View text = tkn.data();
+			if (_options.lazy_numbers)
+			{
+				push(J_Tape::TAG_NUMBER_TEXT, text.count);
+				_tape.words.push(uint64_t(uintptr_t(text.ptr)));
+				break;
+			}
+			push(J_Tape::TAG_NUMBER, 0);
+			_tape.words.push(std::bit_cast<uint64_t>(Number::parse(text).to_double()));
+			break;
+		}
+
+		case JSON_Token::T_string:
+			push(J_Tape::TAG_STRING, uint64_t(uintptr_t(_strings.decode(tkn.data()))));
+			break;
+
+		case JSON_Token::T_lbracket:
+		case JSON_Token::T_lbrace:
+			if (_open.full())
+				return Error{"Nesting too deep"};
+			push(tkn.kind() == JSON_Token::T_lbracket ? J_Tape::TAG_ARRAY : J_Tape::TAG_OBJECT, 0);
+			_open.push(Open{.start = _tape.words.size() - 1, .count = 0});
+			break;
+
+		case JSON_Token::T_rbracket:
+		case JSON_Token::T_rbrace: {
+			Open open = _open.top();
+			_open.pop();
+
+			size_t end = _tape.words.size();
+			if (tkn.kind() == JSON_Token::T_rbracket)
+			{
+				_tape.words._items[open.start] = J_Tape::word(J_Tape::TAG_ARRAY, end + 1);
+				_tape.words.push(J_Tape::word(J_Tape::TAG_ARRAY_END, open.count));
+			}
+			else
+			{
+				_tape.words._items[open.start] = J_Tape::word(J_Tape::TAG_OBJECT, end + 1);
+				_tape.words.push(J_Tape::word(J_Tape::TAG_OBJECT_END, open.count / 2));
+			}
+			break;
+		}
+
+		default: break;
+		}
+		return Error{};
+	}
+};
+
+// Hands every value straight to J_Sax_Callbacks and keeps nothing: only whether each open
+// container is an array or an object, and for objects whether a key or a value comes next
+struct Sax_Builder
+{
+	enum LEVEL : uint8_t
+	{
+		LEVEL_ARRAY,
+		LEVEL_OBJECT_KEY,
+		LEVEL_OBJECT_VALUE,
+	};
+
+	Fixed_Stack<LEVEL> _levels;
+	const J_Sax_Callbacks& _callbacks;
+	void* _user;
+	Scratch_Stack<char> _decoded; // strings with escapes, reused for each of them
+
+	Sax_Builder(const J_Parse_Options& options, const J_Sax_Callbacks& callbacks, void* user)
+		: _levels{options.max_depth}, _callbacks(callbacks), _user(user), _decoded{}
+	{
+	}
+
+	// Called for every value, keys excluded, before its callback
+	inline void
+	value()
+	{
+		if (_levels.empty() == false && _levels.top() == LEVEL_OBJECT_VALUE)
+			_levels.top() = LEVEL_OBJECT_KEY;
+	}
+
+	static inline Error
+	call(bool keep_going)
+	{
+		return keep_going ? Error{} : Error{"Stopped by callback"};
+	}
+
+	Error
+	token(const JSON_Token& tkn)
+	{
+		switch (tkn.kind())
+		{
+		case JSON_Token::T_null:
+			value();
+			return _callbacks.on_null ? call(_callbacks.on_null(_user)) : Error{};
+
+		case JSON_Token::T_true:
+		case JSON_Token::T_false:
+			value();
+			return _callbacks.on_bool ? call(_callbacks.on_bool(_user, tkn.kind() == JSON_Token::T_true)) : Error{};
+
+		case JSON_Token::T_number: {
+			value();
+			if (_callbacks.on_number == nullptr)
+				return Error{};
+
+			String_View text = tkn.data();
+			return call(_callbacks.on_number(_user, Number::parse(text).to_double(), text.ptr, text.count));
+		}
+
+		case JSON_Token::T_string: {
+			bool is_key = _levels.empty() == false && _levels.top() == LEVEL_OBJECT_KEY;
+			if (is_key)
+				_levels.top() = LEVEL_OBJECT_VALUE;
+			else
+				value();
+
+			auto callback = is_key ? _callbacks.on_key : _callbacks.on_string;
+			if (callback == nullptr)
+				return Error{};
+
+			String_View raw = tkn.data();
+			if (::memchr(raw.ptr, '\\', raw.count) == nullptr)
+				return call(callback(_user, raw.ptr, raw.count));
+
+			_decoded.truncate(0);
+			_decoded.reserve(raw.count);
+			size_t count = String_Arena::unescape(raw, _decoded.data());
+			return call(callback(_user, _decoded.data(), count));
+		}
+
+		case JSON_Token::T_lbracket:
+		case JSON_Token::T_lbrace: {
+			if (_levels.full())
+				return Error{"Nesting too deep"};
+			value();
+
+			bool is_object = tkn.kind() == JSON_Token::T_lbrace;
+			_levels.push(is_object ? LEVEL_OBJECT_KEY : LEVEL_ARRAY);
+
+			auto callback = is_object ? _callbacks.on_begin_object : _callbacks.on_begin_array;
+			return callback ? call(callback(_user)) : Error{};
+		}
+
+		case JSON_Token::T_rbracket:
+		case JSON_Token::T_rbrace: {
+			_levels.pop();
+			auto callback = tkn.kind() == JSON_Token::T_rbrace ? _callbacks.on_end_object : _callbacks.on_end_array;
+			return callback ? call(callback(_user)) : Error{};
+		}
+
+		default:
+			return Error{};
+		}
+	}
+};
+
+// LL(1) driver, fed one input terminal at a time so it can run in lockstep with the lexer. The
+// matched terminals go to TBuilder, which makes the document out of them.
+template<typename TBuilder>
+struct Parser
+{
+	// Every open container leaves its closing terminal and a trailing N_MORE_* on the stack, and
+	// the innermost production adds at most MAX_RHS symbols on top of those
+	static constexpr size_t
+	stack_capacity(size_t max_depth)
+	{
+		return 2 * (max_depth + 1) + Production::MAX_RHS;
+	}
+
+	Fixed_Stack<JSON_Token::KIND> _stack;
+	TBuilder& _builder;
+
+	Parser(const J_Parse_Options& options, TBuilder& builder) : _stack{stack_capacity(options.max_depth)}, _builder(builder)
+	{
+		_stack.push(JSON_Token::META_START);
+	}
+
+	void
+	reset()
+	{
+		while (_stack.empty() == false)
+			_stack.pop();
+		_stack.push(JSON_Token::META_START);
+	}
+
+	// Expands productions until `input_terminal` is matched, META_END_OF_INPUT is only matched
+	// once the start symbol has been fully derived
+	Error
+	feed(const JSON_Token& input_terminal)
+	{
+		ZoneScoped;
+
+		while (_stack.empty() == false)
+		{
+			JSON_Token top{_stack.top()};
+			if (input_terminal.is_equal(top))
+			{
+				_stack.pop();
+				return _builder.token(input_terminal);
+			}
+			else if (top.is_terminal())
+			{
+				return Error{"Unexpected terminal"};
+			}
+			else
+			{
+				const Production& production = JSON_PTABLE(top.kind(), input_terminal.kind());
+				if (production.defined == false)
+					return Error{"Unexpected terminal"};
+
+				_stack.pop();
+				for (size_t i = production.count; i > 0; i--)
+					_stack.push(production.rhs[i - 1]);
+			}
+		}
+
+		if (input_terminal.is_equal(JSON_Token::META_END_OF_INPUT) == false)
+			return Error{"Trailing characters"};
+		return Error{};
+	}
+
+	Error
+	parse(std::span<const Compact_Token> tokens, const char* base)
+	{
+		ZoneScoped;
+
+		for (const Compact_Token* it = tokens.data(); it != tokens.data() + tokens.size();)
+		{
+			if (auto err = feed(Compact_Token::pop(it, base)))
+				return err;
+		}
+
+		if (_stack.empty() == false)
+			return Error{"Incomplete"};
+		return Error{};
+	}
+};
+
+// Hand-specialized engine for the grammar in fill_ptable: the whole LL(1) stack collapses into
+// which terminals may come next, and the kinds of the containers still open
+template<typename TBuilder>
+struct State_Machine_Parser
+{
+	enum EXPECT : uint8_t
+	{
+		EXPECT_VALUE,          // start of input, after ':', and after ',' in arrays
+		EXPECT_VALUE_OR_CLOSE, // after '['
+		EXPECT_KEY,            // after ',' in objects
+		EXPECT_KEY_OR_CLOSE,   // after '{'
+		EXPECT_COLON,
+		EXPECT_COMMA_OR_CLOSE, // after a value in a container
+		EXPECT_END_OF_INPUT,   // after the top-level value
+		EXPECT_NOTHING,        // the input has ended
+	};
+
+	EXPECT _expect;
+	Fixed_Stack<JSON_Token::KIND> _containers; // T_lbracket or T_lbrace
+	TBuilder& _builder;
+
+	State_Machine_Parser(const J_Parse_Options& options, TBuilder& builder)
+		: _expect(EXPECT_VALUE), _containers{options.max_depth}, _builder(builder)
+	{
+	}
+
+	void
+	reset()
+	{
+		_expect = EXPECT_VALUE;
+		while (_containers.empty() == false)
+			_containers.pop();
+	}
+
+	inline void
+	end_value()
+	{
+		_expect = _containers.empty() ? EXPECT_END_OF_INPUT : EXPECT_COMMA_OR_CLOSE;
+	}
+
+	inline Error
+	close(const JSON_Token& token)
+	{
+		_containers.pop();
+		end_value();
+		return _builder.token(token);
+	}
+
+	Error
+	feed(const JSON_Token& token)
+	{
+		ZoneScoped;
+
+		JSON_Token::KIND kind = token.kind();
+		switch (_expect)
+		{
+		case EXPECT_VALUE_OR_CLOSE:
+			if (kind == JSON_Token::T_rbracket)
+				return close(token);
+			[[fallthrough]];
+
+		case EXPECT_VALUE:
+			switch (kind)
+			{
+			case JSON_Token::T_null:
+			case JSON_Token::T_true:
+			case JSON_Token::T_false:
+			case JSON_Token::T_number:
+			case JSON_Token::T_string:
+				end_value();
+				return _builder.token(token);
+
+			case JSON_Token::T_lbracket:
+			case JSON_Token::T_lbrace:
+				if (_containers.full())
+					return Error{"Nesting too deep"};
+				_containers.push(kind);
+				_expect = kind == JSON_Token::T_lbracket ? EXPECT_VALUE_OR_CLOSE : EXPECT_KEY_OR_CLOSE;
+				return _builder.token(token);
+
+			default:
+				return Error{"Unexpected terminal"};
+			}
+
+		case EXPECT_KEY_OR_CLOSE:
+			if (kind == JSON_Token::T_rbrace)
+				return close(token);
+			[[fallthrough]];
+
+		case EXPECT_KEY:
+			if (kind != JSON_Token::T_string)
+				return Error{"Unexpected terminal"};
+			_expect = EXPECT_COLON;
+			return _builder.token(token);
+
+		case EXPECT_COLON:
+			if (kind != JSON_Token::T_colon)
+				return Error{"Unexpected terminal"};
+			_expect = EXPECT_VALUE;
+			return Error{};
+
+		case EXPECT_COMMA_OR_CLOSE:
+			if (kind == JSON_Token::T_comma)
+			{
+				_expect = _containers.top() == JSON_Token::T_lbracket ? EXPECT_VALUE : EXPECT_KEY;
+				return Error{};
+			}
+			if (kind == (_containers.top() == JSON_Token::T_lbracket ? JSON_Token::T_rbracket : JSON_Token::T_rbrace))
+				return close(token);
+			return Error{"Unexpected terminal"};
+
+		case EXPECT_END_OF_INPUT:
+			if (kind != JSON_Token::META_END_OF_INPUT)
+				return Error{"Trailing characters"};
+			_expect = EXPECT_NOTHING;
+			return Error{};
+
+		case EXPECT_NOTHING:
+		default:
+			return Error{"Trailing characters"};
+		}
+	}
+
+	Error
+	parse(std::span<const Compact_Token> tokens, const char* base)
+	{
+		ZoneScoped;
+
+		for (const Compact_Token* it = tokens.data(); it != tokens.data() + tokens.size();)
+		{
+			if (auto err = feed(Compact_Token::pop(it, base)))
+				return err;
+		}
+
+		if (_expect != EXPECT_NOTHING)
+			return Error{"Incomplete"};
+		return Error{};
+	}
+};
+
+// Stage 1: classifies the input 64 bytes at a time into bitmasks and yields the offsets of
+// every structural character, every unescaped quote (opening and closing), and the first byte
+// of every scalar (number/literal/garbage) outside of strings. Whitespace and string bodies
+// are never visited by the lexer, only by this bulk pass.
+struct Structural_Index
+{
+	static constexpr size_t BLOCK_SIZE = 64;
+
+	struct Block
+	{
+		uint64_t backslash;
+		uint64_t quote;
+		uint64_t whitespace;
+		uint64_t op; // , : [ ] { }
+	};
+
+	const char* _base;
+	size_t _size;
+
+	size_t _next_block;  // offset of the next block to classify
+	size_t _block;       // offset of the block `_bits` belongs to
+	uint64_t _bits;      // remaining index bits of the current block
+
+	// carried from one block to the next
+	uint64_t _prev_escaped;   // 1 if the first byte of the next block is escaped
+	uint64_t _prev_in_string; // all ones if the previous block ended inside a string
+	uint64_t _prev_scalar;    // 1 if the previous block ended inside a scalar
+
+	Structural_Index() = default;
+	Structural_Index(std::string_view string)
+		: _base(string.data()), _size(string.size()),
+		  _next_block(0), _block(0), _bits(0),
+		  _prev_escaped(0), _prev_in_string(0), _prev_scalar(0)
+	{
+	}
+
+	static inline Block
+	classify(const char* ptr)
+	{
+#if defined(__AVX2__)
+		auto mask32 = [](__m256i v) -> uint64_t { return (uint64_t)(uint32_t)_mm256_movemask_epi8(v); };
+
+		// One shuffle by the low nibble classifies a byte: whitespace bytes are the only ones equal to
+		// their nibble's entry, ops the only ones whose `| 0x20` is (besides the control bytes 0x0c and
+		// 0x1a, which the lexer rejects since it dispatches on the byte itself)
+		const __m256i ws_table = _mm256_setr_epi8(
+			' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100,
+			' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100);
+		const __m256i op_table = _mm256_setr_epi8(
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0,
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+
+		Block block{};
+		for (size_t i = 0; i < BLOCK_SIZE; i += 32)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i*)(ptr + i));
+			__m256i ws = _mm256_cmpeq_epi8(v, _mm256_shuffle_epi8(ws_table, v));
+			__m256i op = _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_shuffle_epi8(op_table, v));
+
+			block.backslash  |= mask32(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+			block.quote      |= mask32(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+			block.whitespace |= mask32(ws) << i;
+			block.op         |= mask32(op) << i;
+		}
+		return block;
+#elif JSON_PARSER_SSE2
+		auto mask16 = [](__m128i v) -> uint64_t { return (uint64_t)(uint16_t)_mm_movemask_epi8(v); };
+
+		Block block{};
+		for (size_t i = 0; i < BLOCK_SIZE; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(ptr + i));
+
+			// '[' | 0x20 == '{' and ']' | 0x20 == '}'
+			__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+			__m128i op = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(',')), _mm_cmpeq_epi8(v, _mm_set1_epi8(':'))),
+				_mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))));
+
+			__m128i ws = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+
+			block.backslash  |= mask16(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+			block.quote      |= mask16(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+			block.whitespace |= mask16(ws) << i;
+			block.op         |= mask16(op) << i;
+		}
+		return block;
+#else
+		Block block{};
+		if constexpr (std::endian::native == std::endian::little)
+		{
+			// SWAR, 8 bytes at a time: `eq` sets the high bit of every byte equal to `c` (exactly, no
+			// borrows across bytes), and `gather` packs those high bits into the low byte
+			constexpr uint64_t ONES = 0x0101010101010101;
+			constexpr uint64_t LOW_BITS = 0x7F7F7F7F7F7F7F7F;
+			auto eq = [](uint64_t word, uint8_t c) -> uint64_t {
+				word ^= ONES * c;
+				return ~(((word & LOW_BITS) + LOW_BITS) | word | LOW_BITS);
+			};
+			auto gather = [](uint64_t high_bits) -> uint64_t { return ((high_bits >> 7) * 0x0102040810204080) >> 56; };
+
+			for (size_t i = 0; i < BLOCK_SIZE; i += 8)
+			{
+				uint64_t word;
+				::memcpy(&word, ptr + i, sizeof(word));
+
+				// '[' | 0x20 == '{' and ']' | 0x20 == '}'
+				uint64_t lower = word | (ONES * 0x20);
+				uint64_t op = eq(word, ',') | eq(word, ':') | eq(lower, '{') | eq(lower, '}');
+				uint64_t ws = eq(word, ' ') | eq(word, '\t') | eq(word, '\n') | eq(word, '\r');
+
+				block.backslash  |= gather(eq(word, '\\')) << i;
+				block.quote      |= gather(eq(word, '"')) << i;
+				block.whitespace |= gather(ws) << i;
+				block.op         |= gather(op) << i;
+			}
+			return block;
+		}
+
+		for (size_t i = 0; i < BLOCK_SIZE; i++)
+		{
+			uint64_t bit = uint64_t(1) << i;
+			switch (ptr[i])
+			{
+			case '\\': block.backslash |= bit; break;
+			case '"': block.quote |= bit; break;
+			case ' ': case '\t': case '\n': case '\r': block.whitespace |= bit; break;
+			case ',': case ':': case '[': case ']': case '{': case '}': block.op |= bit; break;
+			default: break;
+			}
+		}
+		return block;
+#endif
+	}
+
+	// Marks every byte preceded by an odd-length run of backslashes
+	inline uint64_t
+	find_escaped(uint64_t backslash)
+	{
+		constexpr uint64_t EVEN_BITS = 0x5555555555555555;
+
+		backslash &= ~_prev_escaped;
+		uint64_t follows_escape = (backslash << 1) | _prev_escaped;
+
+		// Adding a run's start to the run carries one bit past its end, runs starting on odd bits
+		// are added so that the byte after an odd-length run always lands on the "wrong" parity
+		uint64_t odd_sequence_starts = backslash & ~EVEN_BITS & ~follows_escape;
+		uint64_t sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+		_prev_escaped = sequences_starting_on_even_bits < backslash;
+
+		uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+		return (EVEN_BITS ^ invert_mask) & follows_escape;
+	}
+
+	static inline uint64_t
+	prefix_xor(uint64_t bits)
+	{
+		bits ^= bits << 1;
+		bits ^= bits << 2;
+		bits ^= bits << 4;
+		bits ^= bits << 8;
+		bits ^= bits << 16;
+		bits ^= bits << 32;
+		return bits;
+	}
+
+	// Classifies the block at `offset`, a last block that runs past `size` is padded with spaces
+	static inline Block
+	classify(const char* base, size_t size, size_t offset)
+	{
+		if (size - offset >= BLOCK_SIZE)
+			return classify(base + offset);
+
+		char tail[BLOCK_SIZE];
+		::memset(tail, ' ', BLOCK_SIZE);
+		::memcpy(tail, base + offset, size - offset);
+		return classify(tail);
+	}
+
+	inline void
+	next_block()
+	{
+		ZoneScoped;
+
+		Block block = classify(_base, _size, _next_block);
+
+		uint64_t escaped = find_escaped(block.backslash);
+		uint64_t quote = block.quote & ~escaped;
+
+		// in_string covers the opening quote and the string body, but not the closing quote
+		uint64_t in_string = prefix_xor(quote) ^ _prev_in_string;
+		_prev_in_string = uint64_t(int64_t(in_string) >> 63);
+
+		uint64_t op = block.op & ~in_string;
+		uint64_t scalar = ~(block.op | block.whitespace | quote | in_string);
+		uint64_t scalar_start = scalar & ~((scalar << 1) | _prev_scalar);
+		_prev_scalar = scalar >> 63;
+
+		_block = _next_block;
+		_bits = op | quote | scalar_start;
+		_next_block += BLOCK_SIZE;
+	}
+
+	inline bool
+	next(size_t& offset)
+	{
+		while (_bits == 0)
+		{
+			if (_next_block >= _size)
+				return false;
+			next_block();
+		}
+
+		offset = _block + std::countr_zero(_bits);
+		_bits &= _bits - 1;
+		return true;
+	}
+};
+
+// The lexer's scanners for scalars and string bodies are a single DFA: one lookup to classify the
+// byte, one lookup in a flat state-by-class transition table, and one branch to check whether the
+// scan is over. Both tables are generated at compile time.
+struct Lexer_DFA
+{
+	// Bytes that no transition tells apart share a class
+	enum CLASS : uint8_t
+	{
+		CLASS_OTHER,      // anything else, including every non-ASCII byte
+		CLASS_SPACE,      // ' '
+		CLASS_WS_CONTROL, // \t \n \r, whitespace outside of strings but control characters inside them
+		CLASS_CONTROL,    // the other control characters
+		CLASS_OP,         // , : [ ] { }
+		CLASS_QUOTE,
+		CLASS_BACKSLASH,
+		CLASS_SLASH,
+		CLASS_ZERO,
+		CLASS_DIGIT,      // 1-9
+		CLASS_MINUS,
+		CLASS_PLUS,
+		CLASS_DOT,
+		CLASS_HEX,        // the hex letters with no other role: A-D F c d
+		CLASS_E,
+		CLASS_a,
+		CLASS_b,
+		CLASS_e,
+		CLASS_f,
+		CLASS_l,
+		CLASS_n,
+		CLASS_r,
+		CLASS_s,
+		CLASS_t,
+		CLASS_u,
+		CLASS_END,        // never a byte, fed once the input runs out
+
+		CLASS_COUNT,
+	};
+
+	enum STATE : uint8_t
+	{
+		STATE_0,
+
+		STATE_T,
+		STATE_TR,
+		STATE_TRU,
+		STATE_TRUE,
+
+		STATE_F,
+		STATE_FA,
+		STATE_FAL,
+		STATE_FALS,
+		STATE_FALSE,
+
+		STATE_N,
+		STATE_NU,
+		STATE_NUL,
+		STATE_NULL,
+
+		STATE_NUMBER_MINUS,
+		STATE_NUMBER_INTEGER,
+		STATE_NUMBER_INTEGER_LEADING_ZERO,
+		STATE_NUMBER_FRACTION,
+		STATE_NUMBER_FRACTION_DIGITS,
+		STATE_NUMBER_EXPONENT,
+		STATE_NUMBER_EXPONENT_SIGN,
+		STATE_NUMBER_EXPONENT_DIGITS,
+
+		STATE_STRING,
+		STATE_BACKSLASH,
+		STATE_u,
+		STATE_uX,
+		STATE_uXX,
+		STATE_uXXX,
+
+		// Reaching any of the following states ends the scan
+		STATE_FINAL,
+
+		STATE_ACCEPT_TRUE = STATE_FINAL,
+		STATE_ACCEPT_FALSE,
+		STATE_ACCEPT_NULL,
+		STATE_ACCEPT_NUMBER,
+		STATE_ACCEPT_STRING,
+
+		STATE_ERROR_INVALID_CHARACTER,
+		STATE_ERROR_UNEXPECTED_TERMINAL,
+		STATE_ERROR_NUMBER,
+		STATE_ERROR_LEADING_ZERO,
+		STATE_ERROR_FRACTION,
+		STATE_ERROR_EXPONENT,
+		STATE_ERROR_CONTROL_CHARACTER,
+		STATE_ERROR_ESCAPED_CHARACTER,
+		STATE_ERROR_ESCAPED_UNICODE,
+		STATE_ERROR_UNTERMINATED_STRING,
+	};
+
+	std::array<CLASS, 256> classes;
+	std::array<std::array<STATE, CLASS_COUNT>, STATE_FINAL> transitions;
+
+	static constexpr const char*
+	error(STATE state)
+	{
+		switch (state)
+		{
+		case STATE_ERROR_INVALID_CHARACTER:   return "Invalid character";
+		case STATE_ERROR_UNEXPECTED_TERMINAL: return "Unexpected terminal";
+		case STATE_ERROR_NUMBER:              return "Invalid character in number";
+		case STATE_ERROR_LEADING_ZERO:        return "Leading zero";
+		case STATE_ERROR_FRACTION:            return "Invalid fraction";
+		case STATE_ERROR_EXPONENT:            return "Invalid exponent";
+		case STATE_ERROR_CONTROL_CHARACTER:   return "Invalid unicode character";
+		case STATE_ERROR_ESCAPED_CHARACTER:   return "Invalid escaped character";
+		case STATE_ERROR_ESCAPED_UNICODE:     return "Invalid escaped unicode";
+		case STATE_ERROR_UNTERMINATED_STRING: return "Unterminated string";
+		default:
+			unreachable("Not an error state");
+			return "";
+		}
+	}
+
+	static constexpr Lexer_DFA
+	make()
+	{
+		Lexer_DFA dfa{};
+
+		for (size_t c = 0; c < 0x20; c++)
+			dfa.classes[c] = CLASS_CONTROL;
+		dfa.classes[' '] = CLASS_SPACE;
+		dfa.classes['\t'] = dfa.classes['\n'] = dfa.classes['\r'] = CLASS_WS_CONTROL;
+		for (char c: {',', ':', '[', ']', '{', '}'})
+			dfa.classes[(uint8_t)c] = CLASS_OP;
+		dfa.classes['"'] = CLASS_QUOTE;
+		dfa.classes['\\'] = CLASS_BACKSLASH;
+		dfa.classes['/'] = CLASS_SLASH;
+		dfa.classes['0'] = CLASS_ZERO;
+		for (char c = '1'; c <= '9'; c++)
+			dfa.classes[(uint8_t)c] = CLASS_DIGIT;
+		dfa.classes['-'] = CLASS_MINUS;
+		dfa.classes['+'] = CLASS_PLUS;
+		dfa.classes['.'] = CLASS_DOT;
+		for (char c: {'A', 'B', 'C', 'D', 'F', 'c', 'd'})
+			dfa.classes[(uint8_t)c] = CLASS_HEX;
+		dfa.classes['E'] = CLASS_E;
+		dfa.classes['a'] = CLASS_a;
+		dfa.classes['b'] = CLASS_b;
+		dfa.classes['e'] = CLASS_e;
+		dfa.classes['f'] = CLASS_f;
+		dfa.classes['l'] = CLASS_l;
+		dfa.classes['n'] = CLASS_n;
+		dfa.classes['r'] = CLASS_r;
+		dfa.classes['s'] = CLASS_s;
+		dfa.classes['t'] = CLASS_t;
+		dfa.classes['u'] = CLASS_u;
+
+		constexpr CLASS DELIMITERS[]{CLASS_SPACE, CLASS_WS_CONTROL, CLASS_OP, CLASS_QUOTE, CLASS_END};
+		constexpr CLASS DIGITS[]{CLASS_ZERO, CLASS_DIGIT};
+		constexpr CLASS HEX_DIGITS[]{CLASS_ZERO, CLASS_DIGIT, CLASS_HEX, CLASS_E, CLASS_a, CLASS_b, CLASS_e, CLASS_f};
+
+		auto fill = [&](STATE state, STATE next) {
+			for (auto& t: dfa.transitions[state])
+				t = next;
+		};
+
+		// Scalars end at the first delimiter, which is left for the structural index
+		fill(STATE_0, STATE_ERROR_INVALID_CHARACTER);
+
+		auto literal = [&](std::initializer_list<std::pair<STATE, CLASS>> chain, STATE last, STATE accept) {
+			STATE prev = STATE_0;
+			for (auto [state, cls]: chain)
+			{
+				if (prev != STATE_0)
+					fill(prev, STATE_ERROR_UNEXPECTED_TERMINAL);
+				dfa.transitions[prev][cls] = state;
+				prev = state;
+			}
+			fill(last, STATE_ERROR_INVALID_CHARACTER);
+			for (auto cls: DELIMITERS)
+				dfa.transitions[last][cls] = accept;
+		};
+		literal({{STATE_T, CLASS_t}, {STATE_TR, CLASS_r}, {STATE_TRU, CLASS_u}, {STATE_TRUE, CLASS_e}}, STATE_TRUE, STATE_ACCEPT_TRUE);
+		literal({{STATE_F, CLASS_f}, {STATE_FA, CLASS_a}, {STATE_FAL, CLASS_l}, {STATE_FALS, CLASS_s}, {STATE_FALSE, CLASS_e}}, STATE_FALSE, STATE_ACCEPT_FALSE);
+		literal({{STATE_N, CLASS_n}, {STATE_NU, CLASS_u}, {STATE_NUL, CLASS_l}, {STATE_NULL, CLASS_l}}, STATE_NULL, STATE_ACCEPT_NULL);
+
+		// Numbers
+		dfa.transitions[STATE_0][CLASS_MINUS] = STATE_NUMBER_MINUS;
+		dfa.transitions[STATE_0][CLASS_ZERO] = STATE_NUMBER_INTEGER_LEADING_ZERO;
+		dfa.transitions[STATE_0][CLASS_DIGIT] = STATE_NUMBER_INTEGER;
+
+		fill(STATE_NUMBER_MINUS, STATE_ERROR_NUMBER);
+		dfa.transitions[STATE_NUMBER_MINUS][CLASS_ZERO] = STATE_NUMBER_INTEGER_LEADING_ZERO;
+		dfa.transitions[STATE_NUMBER_MINUS][CLASS_DIGIT] = STATE_NUMBER_INTEGER;
+
+		for (auto state: {STATE_NUMBER_INTEGER, STATE_NUMBER_INTEGER_LEADING_ZERO, STATE_NUMBER_FRACTION_DIGITS, STATE_NUMBER_EXPONENT_DIGITS})
+		{
+			fill(state, STATE_ERROR_INVALID_CHARACTER);
+			for (auto cls: DELIMITERS)
+				dfa.transitions[state][cls] = STATE_ACCEPT_NUMBER;
+			for (auto cls: DIGITS)
+				dfa.transitions[state][cls] = state;
+			if (state != STATE_NUMBER_EXPONENT_DIGITS)
+				dfa.transitions[state][CLASS_E] = dfa.transitions[state][CLASS_e] = STATE_NUMBER_EXPONENT;
+		}
+		for (auto cls: DIGITS)
+			dfa.transitions[STATE_NUMBER_INTEGER_LEADING_ZERO][cls] = STATE_ERROR_LEADING_ZERO;
+		dfa.transitions[STATE_NUMBER_INTEGER][CLASS_DOT] = STATE_NUMBER_FRACTION;
+		dfa.transitions[STATE_NUMBER_INTEGER_LEADING_ZERO][CLASS_DOT] = STATE_NUMBER_FRACTION;
+
+		fill(STATE_NUMBER_FRACTION, STATE_ERROR_FRACTION);
+		for (auto cls: DIGITS)
+			dfa.transitions[STATE_NUMBER_FRACTION][cls] = STATE_NUMBER_FRACTION_DIGITS;
+
+		fill(STATE_NUMBER_EXPONENT, STATE_ERROR_EXPONENT);
+		dfa.transitions[STATE_NUMBER_EXPONENT][CLASS_PLUS] = STATE_NUMBER_EXPONENT_SIGN;
+		dfa.transitions[STATE_NUMBER_EXPONENT][CLASS_MINUS] = STATE_NUMBER_EXPONENT_SIGN;
+		fill(STATE_NUMBER_EXPONENT_SIGN, STATE_ERROR_EXPONENT);
+		for (auto state: {STATE_NUMBER_EXPONENT, STATE_NUMBER_EXPONENT_SIGN})
+			for (auto cls: DIGITS)
+				dfa.transitions[state][cls] = STATE_NUMBER_EXPONENT_DIGITS;
+
+		// String bodies, the opening quote is consumed by the caller
+		fill(STATE_STRING, STATE_STRING);
+		dfa.transitions[STATE_STRING][CLASS_QUOTE] = STATE_ACCEPT_STRING;
+		dfa.transitions[STATE_STRING][CLASS_BACKSLASH] = STATE_BACKSLASH;
+		dfa.transitions[STATE_STRING][CLASS_CONTROL] = STATE_ERROR_CONTROL_CHARACTER;
+		dfa.transitions[STATE_STRING][CLASS_WS_CONTROL] = STATE_ERROR_CONTROL_CHARACTER;
+		dfa.transitions[STATE_STRING][CLASS_END] = STATE_ERROR_UNTERMINATED_STRING;
+
+		fill(STATE_BACKSLASH, STATE_ERROR_ESCAPED_CHARACTER);
+		for (auto cls: {CLASS_QUOTE, CLASS_BACKSLASH, CLASS_SLASH, CLASS_b, CLASS_f, CLASS_n, CLASS_r, CLASS_t})
+			dfa.transitions[STATE_BACKSLASH][cls] = STATE_STRING;
+		dfa.transitions[STATE_BACKSLASH][CLASS_u] = STATE_u;
+
+		for (auto state: {STATE_u, STATE_uX, STATE_uXX, STATE_uXXX})
+		{
+			fill(state, STATE_ERROR_ESCAPED_UNICODE);
+			for (auto cls: HEX_DIGITS)
+				dfa.transitions[state][cls] = state == STATE_uXXX ? STATE_STRING : STATE(state + 1);
+		}
+		for (auto state: {STATE_BACKSLASH, STATE_u, STATE_uX, STATE_uXX, STATE_uXXX})
+			dfa.transitions[state][CLASS_END] = STATE_ERROR_UNTERMINATED_STRING;
+
+		return dfa;
+	}
+};
+
+constexpr Lexer_DFA JSON_DFA = Lexer_DFA::make();
+
+struct Lexer
+{
+	using STATE = Lexer_DFA::STATE;
+
+	// Returned for a token cut off by the end of a chunk, see _chunked
+	static constexpr char INCOMPLETE[] = "Incomplete token";
+
+	std::string_view _string;
+	Structural_Index _index;
+
+	// Set when more input may follow _string: a token running into its end fails with INCOMPLETE
+	// and _incomplete is left on the token's first byte
+	bool _chunked = false;
+	size_t _incomplete = 0;
+
+	Lexer() = default;
+	Lexer(std::string_view string) : _string(string), _index{string}
+	{
+	}
+
+	// Returns the first byte in [it, end) that a string body can't just skip over: a quote, a
+	// backslash, a control character or the start of a multi-byte sequence
+	static inline const uint8_t*
+	find_string_special(const uint8_t* it, const uint8_t* end)
+	{
+#if defined(__AVX2__)
+		for (; end - it >= 32; it += 32)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i*)it);
+			__m256i special = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), v)); // signed, catches both < 0x20 and >= 0x80
+
+			if (uint32_t mask = (uint32_t)_mm256_movemask_epi8(special))
+				return it + std::countr_zero(mask);
+		}
+#endif
+
+#if JSON_PARSER_SSE2
+		for (; end - it >= 16; it += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)it);
+			__m128i special = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+				_mm_cmplt_epi8(v, _mm_set1_epi8(0x20))); // signed, catches both < 0x20 and >= 0x80
+
+			if (uint32_t mask = (uint32_t)_mm_movemask_epi8(special))
+				return it + std::countr_zero(mask);
+		}
+#endif
+
+		constexpr uint64_t ONES = 0x0101010101010101;
+		constexpr uint64_t HIGH_BITS = 0x8080808080808080;
+		for (; end - it >= 8; it += 8)
+		{
+			uint64_t word;
+			::memcpy(&word, it, sizeof(word));
+
+			uint64_t quote = word ^ (ONES * '"');
+			uint64_t backslash = word ^ (ONES * '\\');
+			uint64_t special =
+				((quote - ONES) & ~quote) |
+				((backslash - ONES) & ~backslash) |
+				((word - ONES * 0x20) & ~word) |
+				word;
+			if (special & HIGH_BITS)
+				break;
+		}
+
+		for (; it < end; it++)
+		{
+			if (*it == '"' || *it == '\\' || *it < 0x20 || *it >= 0x80)
+				return it;
+		}
+		return end;
+	}
+
+	// JSON only allows non-ASCII inside strings, so this only ever runs on string bodies, and only
+	// for the bytes the string scanner stopped at
+	static inline Error
+	validate_utf8_sequence(const uint8_t*& it, const uint8_t* end)
+	{
+		// Well-formed sequences, The Unicode Standard, Table 3-7
+		uint8_t lead = *it;
+		size_t size = 0;
+		uint8_t second_min = 0x80, second_max = 0xBF;
+		if (0xC2 <= lead && lead <= 0xDF) size = 2;
+		else if (lead == 0xE0) size = 3, second_min = 0xA0;
+		else if (lead == 0xED) size = 3, second_max = 0x9F;
+		else if (0xE1 <= lead && lead <= 0xEF) size = 3;
+		else if (lead == 0xF0) size = 4, second_min = 0x90;
+		else if (lead == 0xF4) size = 4, second_max = 0x8F;
+		else if (0xF1 <= lead && lead <= 0xF3) size = 4;
+		else return Error{"Invalid UTF-8 string"};
+
+		if (size_t(end - it) < size || it[1] < second_min || it[1] > second_max)
+			return Error{"Invalid UTF-8 string"};
+
+		for (size_t i = 2; i < size; i++)
+			if ((it[i] & 0xC0) != 0x80)
+				return Error{"Invalid UTF-8 string"};
+
+		it += size;
+		return Error{};
+	}
+
+	// Runs the DFA from `state` until it reaches a final state, `it` is left on the byte that
+	// caused the transition (or the end of input, which is fed as its own class)
+	inline STATE
+	run(STATE state, size_t& it)
+	{
+		const uint8_t* BASE = (const uint8_t*)_string.data();
+		const size_t SIZE = _string.size();
+
+		for (; it < SIZE; it++)
+		{
+			state = JSON_DFA.transitions[state][JSON_DFA.classes[BASE[it]]];
+			if (state >= Lexer_DFA::STATE_FINAL)
+				return state;
+		}
+		return JSON_DFA.transitions[state][Lexer_DFA::CLASS_END];
+	}
+
+	// Runs the DFA over the escape sequence starting at the backslash `it` points to, and leaves
+	// `it` right after it
+	inline Error
+	scan_escape(const uint8_t*& it)
+	{
+		STATE state = Lexer_DFA::STATE_BACKSLASH;
+		do
+		{
+			state = JSON_DFA.transitions[state][JSON_DFA.classes[*++it]];
+			if (state >= Lexer_DFA::STATE_FINAL)
+				return Error{Lexer_DFA::error(state)};
+		} while (state != Lexer_DFA::STATE_STRING);
+
+		it++;
+		return Error{};
+	}
+
+	inline Error
+	scan_string(size_t open_quote, size_t close_quote, JSON_Token& token)
+	{
+		ZoneScoped;
+
+		const uint8_t* BASE = (const uint8_t*)_string.data();
+		const uint8_t* end = BASE + close_quote + 1;
+
+		const uint8_t* it = BASE + open_quote + 1;
+		while (true)
+		{
+			it = find_string_special(it, end);
+			assert(it < end);
+
+			if (*it == '"')
+				break;
+
+			if (*it == '\\')
+			{
+				if (auto err = scan_escape(it))
+					return err;
+			}
+			else if (*it < 0x20)
+			{
+				return Error{Lexer_DFA::error(Lexer_DFA::STATE_ERROR_CONTROL_CHARACTER)};
+			}
+			else if (auto err = validate_utf8_sequence(it, end))
+			{
+				return err;
+			}
+		}
+		assert(it == BASE + close_quote);
+
+		token = JSON_Token{JSON_Token::T_string, String_View{_string.data() + open_quote + 1, close_quote - open_quote - 1}};
+		return Error{};
+	}
+
+	inline Error
+	scan_scalar(size_t begin, JSON_Token& token)
+	{
+		ZoneScoped;
+
+		size_t it = begin;
+		auto state = run(Lexer_DFA::STATE_0, it);
+		if (_chunked && it == _string.size())
+		{
+			_incomplete = begin;
+			return Error{INCOMPLETE};
+		}
+
+		switch (state)
+		{
+		case Lexer_DFA::STATE_ACCEPT_TRUE:
+			token = JSON_Token{JSON_Token::T_true};
+			return Error{};
+
+		case Lexer_DFA::STATE_ACCEPT_FALSE:
+			token = JSON_Token{JSON_Token::T_false};
+			return Error{};
+
+		case Lexer_DFA::STATE_ACCEPT_NULL:
+			token = JSON_Token{JSON_Token::T_null};
+			return Error{};
+
+		case Lexer_DFA::STATE_ACCEPT_NUMBER:
+			token = JSON_Token{JSON_Token::T_number, String_View{_string.data() + begin, it - begin}};
+			return Error{};
+
+		default:
+			return Error{Lexer_DFA::error(state)};
+		}
+	}
+
+	// Lexes the next token on demand, META_END_OF_INPUT once the input runs out
+	inline Error
+	next(JSON_Token& token)
+	{
+		FrameMark;
+
+		size_t offset = 0;
+		if (_index.next(offset) == false)
+		{
+			token = JSON_Token{JSON_Token::META_END_OF_INPUT};
+			return Error{};
+		}
+
+		switch (char c = _string[offset])
+		{
+		case '"': {
+			size_t close_quote = 0;
+			if (_index.next(close_quote) == false)
+			{
+				_incomplete = offset;
+				return Error{_chunked ? INCOMPLETE : "Unterminated string"};
+			}
+
+			return scan_string(offset, close_quote, token);
+		}
+
+		case ',': case ':': case '[': case ']': case '{': case '}':
+			token = JSON_Token{Rune(c)};
+			return Error{};
+
+		default:
+			return scan_scalar(offset, token);
+		}
+	}
+
+	Result<std::vector<Compact_Token>>
+	lex()
+	{
+		ZoneScoped;
+
+		std::vector<Compact_Token> tokens;
+
+		JSON_Token token{};
+		do
+		{
+			if (auto err = next(token))
+				return err;
+			Compact_Token::push(tokens, _string.data(), token);
+		} while (token.kind() != JSON_Token::META_END_OF_INPUT);
+
+		return std::move(tokens);
+	}
+};
+
+// On-demand documents only hold the input. A J_Cursor is the offset of a value's first byte, and
+// every cursor call lexes from there with a structural index of its own, which is valid since a
+// value never starts inside a string or right after a backslash.
+struct J_Doc
+{
+	std::string_view input;
+	Arena arena;
+	String_Arena strings; // decoded by j_cursor_get_string, kept until j_doc_close
+	const char* err;
+
+	J_Doc(std::string_view input) : input(input), arena{}, strings{&arena}, err(nullptr)
+	{
+	}
+};
+
+struct Cursor_Reader
+{
+	std::string_view _input;
+	size_t _origin;
+	Lexer _lexer;
+
+	Cursor_Reader(std::string_view input, size_t offset)
+		: _input(input), _origin(offset), _lexer{input.substr(offset)}
+	{
+	}
+
+	Cursor_Reader(const J_Cursor& cursor) : Cursor_Reader(cursor.doc->input, cursor.offset)
+	{
+	}
+
+	// Offset in the input of the next structural, or the input's size once it runs out
+	inline size_t
+	next_offset()
+	{
+		size_t offset = 0;
+		if (_lexer._index.next(offset) == false)
+			return _input.size();
+		return _origin + offset;
+	}
+
+	inline char
+	at(size_t offset) const
+	{
+		return offset < _input.size() ? _input[offset] : '\0';
+	}
+
+	// Lexes the token starting at `offset`, which next_offset just returned
+	Error
+	token(size_t offset, JSON_Token& token)
+	{
+		switch (char c = at(offset))
+		{
+		case '\0':
+			token = JSON_Token{JSON_Token::META_END_OF_INPUT};
+			return Error{};
+
+		case '"': {
+			size_t close_quote = next_offset();
+			if (close_quote == _input.size())
+				return Error{"Unterminated string"};
+			return _lexer.scan_string(offset - _origin, close_quote - _origin, token);
+		}
+
+		case ',': case ':': case '[': case ']': case '{': case '}':
+			token = JSON_Token{Rune(c)};
+			return Error{};
+
+		default:
+			return _lexer.scan_scalar(offset - _origin, token);
+		}
+	}
+
+	inline Error
+	next(JSON_Token& tkn)
+	{
+		return token(next_offset(), tkn);
+	}
+
+	// Moves past the value starting at `offset` by matching brackets, its contents aren't lexed.
+	// Bracket kinds are checked too, unless the value nests deeper than 64 levels.
+	Error
+	skip(size_t offset)
+	{
+		size_t depth = 0;
+		uint64_t braces = 0; // one bit per open bracket, set for '{'
+		bool deep = false;
+		while (true)
+		{
+			switch (char c = at(offset))
+			{
+			case '\0':
+				return Error{"Incomplete"};
+
+			case '"':
+				if (next_offset() == _input.size())
+					return Error{"Unterminated string"};
+				break;
+
+			case '[': case '{':
+				depth++;
+				deep |= depth > 64;
+				braces = (braces << 1) | (c == '{');
+				break;
+
+			case ']': case '}':
+				if (depth == 0 || (deep == false && (braces & 1) != (c == '}')))
+					return Error{"Unexpected terminal"};
+				depth--;
+				braces >>= 1;
+				break;
+
+			default:
+				break;
+			}
+
+			if (depth == 0)
+				return Error{};
+			offset = next_offset();
+		}
+	}
+
+	// Compares the body of a key token against `key`, decoding it first if it has escapes
+	static bool
+	key_equals(String_View raw, const char* key, size_t key_size)
+	{
+		if (::memchr(raw.ptr, '\\', raw.count) == nullptr)
+			return raw.count == key_size && ::memcmp(raw.ptr, key, key_size) == 0;
+
+		if (raw.count < key_size)
+			return false;
+
+		std::string decoded(raw.count, '\0');
+		decoded.resize(String_Arena::unescape(raw, decoded.data()));
+		return decoded == std::string_view{key, key_size};
+	}
+};
+
+#pragma section("API")
+
+J_Version
+j_version()
+{
+	return {0, 1, 0};
+}
+
+J_Parse_Result
+j_parse(const char* json_string)
+{
+	return j_parse_with_options(json_string, ::strlen(json_string), J_Parse_Options{});
+}
+
+template<typename TParser>
+Error
+_j_parse(Lexer& lexer, TParser& parser, const char* json_string, J_PARSE_MODE mode)
+{
+	switch (mode)
+	{
+	case J_PARSE_MODE_STREAMING: {
+		JSON_Token token{};
+		do
+		{
+			if (auto err = lexer.next(token))
+				return err;
+
+			if (auto err = parser.feed(token))
+				return err;
+		} while (token.kind() != JSON_Token::META_END_OF_INPUT);
+
+		return Error{};
+	}
+
+	case J_PARSE_MODE_TOKENIZE: {
+		auto [tokens, err] = lexer.lex();
+		if (err)
+			return err;
+
+		return parser.parse(tokens, json_string);
+	}
+
+	default:
+		return Error{"Invalid parse mode"};
+	}
+}
+
+// Runs the engine picked in `options` over the input, feeding `builder`. The builder must have
+// been made with the same options, after resolve_options.
+template<typename TBuilder>
+Error
+_j_parse_with_options(const char* json_string, size_t size, const J_Parse_Options& options, TBuilder& builder)
+{
+	ZoneScoped;
+
+	Lexer lexer{std::string_view{json_string, size}};
+
+	switch (options.engine)
+	{
+	case J_PARSE_ENGINE_TABLE: {
+		Parser parser{options, builder};
+		return _j_parse(lexer, parser, json_string, options.mode);
+	}
+
+	case J_PARSE_ENGINE_STATE_MACHINE: {
+		State_Machine_Parser parser{options, builder};
+		return _j_parse(lexer, parser, json_string, options.mode);
+	}
+
+	default:
+		return Error{"Invalid parse engine"};
+	}
+}
+
+// Fills in the defaults that zero-initialized options stand for
+static J_Parse_Options
+resolve_options(J_Parse_Options options)
+{
+	if (options.max_depth == 0)
+		options.max_depth = J_PARSE_DEFAULT_MAX_DEPTH;
+	return options;
+}
+
+// Runs `f(i)` for every i in [0, count) on up to `threads` threads, the calling thread included
+template<typename F>
+static void
+_j_parallel_for(size_t threads, size_t count, F&& f)
+{
+	std::atomic<size_t> next{0};
+	auto work = [&] {
+		for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+			f(i);
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < std::min(threads, count); i++)
+		workers.emplace_back(work);
+	work();
+	for (auto& worker: workers)
+		worker.join();
+}
+
+// J_Parse_Options.threads: a top-level array or object is cut on the commas between its values,
+// and every piece is parsed on its own as the body of a container of the same kind, then the
+// pieces' values are concatenated. The document is valid exactly when every piece is a valid,
+// non-empty list of values, so the pieces need no validation beyond their own parse.
+//
+// Finding the top-level commas takes two passes over chunks of the input, both parallel. The first
+// one can't know whether its chunk starts inside a string, so it counts the bracket depth change
+// for both cases, and the quotes that flip between them. A serial prefix over the chunks picks the
+// right case for each. The second pass then looks for the first comma at depth 1 in every chunk.
+struct Parallel_Parse
+{
+	static constexpr size_t MIN_CHUNK_SIZE = 1024 * 1024;
+	static constexpr size_t CHUNKS_PER_THREAD = 4; // pieces vary in cost, more of them balance better
+
+	struct Chunk
+	{
+		size_t begin, end;
+		int64_t depth_change[2]; // if the chunk starts outside or inside a string
+		bool flips_string;       // odd number of unescaped quotes
+
+		bool in_string; // at `begin`, from the prefix
+		int64_t depth;  // at `begin`, from the prefix
+		size_t split;   // first top-level comma in the chunk, or SIZE_MAX
+	};
+
+	struct Piece
+	{
+		J_JSON json;
+		Error err;
+	};
+
+	static constexpr std::array<int8_t, 256> DEPTH_CHANGE = [] {
+		std::array<int8_t, 256> change{};
+		change['['] = change['{'] = 1;
+		change[']'] = change['}'] = -1;
+		return change;
+	}();
+
+	std::string_view input;
+	J_Parse_Options options;
+	std::vector<Chunk> chunks;
+
+	// Scans the blocks of `chunk`, calling `op(offset, in_string)` on every , : [ ] { } in order.
+	// The chunk is assumed to start outside of a string, `in_string` is flipped otherwise. Returns
+	// whether the chunk ends inside a string.
+	template<typename F>
+	bool
+	scan(const Chunk& chunk, F&& op)
+	{
+		Structural_Index index{input.substr(chunk.begin, chunk.end - chunk.begin)};
+
+		// Backslashes only escape inside strings, a chunk can start in the middle of a run of them
+		for (size_t it = chunk.begin; it > 0 && input[it - 1] == '\\'; it--)
+			index._prev_escaped ^= 1;
+
+		for (size_t block_offset = 0; block_offset < index._size; block_offset += Structural_Index::BLOCK_SIZE)
+		{
+			auto block = Structural_Index::classify(index._base, index._size, block_offset);
+			uint64_t quote = block.quote & ~index.find_escaped(block.backslash);
+			uint64_t in_string = Structural_Index::prefix_xor(quote) ^ index._prev_in_string;
+			index._prev_in_string = uint64_t(int64_t(in_string) >> 63);
+
+			for (uint64_t bits = block.op; bits; bits &= bits - 1)
+			{
+				size_t i = std::countr_zero(bits);
+				if (op(chunk.begin + block_offset + i, bool((in_string >> i) & 1)) == false)
+					return false;
+			}
+		}
+		return index._prev_in_string != 0;
+	}
+
+	// Parses one piece as the body of a container opened by `open`
+	template<typename TParser>
+	Piece
+	parse_piece(size_t begin, size_t end, JSON_Token::KIND open)
+	{
+		JSON_Builder builder{options, nullptr};
+		TParser parser{options, builder};
+		Lexer lexer{input.substr(begin, end - begin)};
+
+		auto run = [&]() -> Error {
+			if (auto err = parser.feed(JSON_Token{open}))
+				return err;
+
+			JSON_Token token{};
+			while (true)
+			{
+				if (auto err = lexer.next(token))
+					return err;
+				if (token.kind() == JSON_Token::META_END_OF_INPUT)
+					break;
+				if (auto err = parser.feed(token))
+					return err;
+			}
+
+			if (auto err = parser.feed(JSON_Token{open == JSON_Token::T_lbracket ? JSON_Token::T_rbracket : JSON_Token::T_rbrace}))
+				return err;
+			return parser.feed(JSON_Token{JSON_Token::META_END_OF_INPUT});
+		};
+
+		if (auto err = run())
+			return Piece{J_JSON{}, err};
+		return Piece{builder.yield(), Error{}};
+	}
+
+	// Null when the input isn't an array or object big enough to split, the caller parses it whole
+	template<typename TParser>
+	std::optional<J_Parse_Result>
+	parse(size_t threads)
+	{
+		ZoneScoped;
+
+		auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+		size_t open = 0, close = input.size();
+		while (open < input.size() && is_space(input[open]))
+			open++;
+		while (close > open && is_space(input[close - 1]))
+			close--;
+		if (close - open < 2 || (input[open] != '[' && input[open] != '{') || input[close - 1] != input[open] + 2)
+			return std::nullopt;
+		close--;
+
+		size_t chunk_count = std::min(threads * CHUNKS_PER_THREAD, (close - open) / MIN_CHUNK_SIZE);
+		if (chunk_count < 2)
+			return std::nullopt;
+
+		// Whole blocks, so that the scans classify the same blocks whichever chunk they start in
+		size_t chunk_size = ((close - open) / chunk_count + Structural_Index::BLOCK_SIZE - 1) & ~(Structural_Index::BLOCK_SIZE - 1);
+		for (size_t begin = open; begin < close; begin += chunk_size)
+			chunks.push_back(Chunk{.begin = begin, .end = std::min(begin + chunk_size, close), .split = SIZE_MAX});
+
+		_j_parallel_for(threads, chunks.size(), [&](size_t i) {
+			Chunk& chunk = chunks[i];
+			chunk.flips_string = scan(chunk, [&](size_t offset, bool in_string) {
+				chunk.depth_change[in_string] += DEPTH_CHANGE[(uint8_t)input[offset]];
+				return true;
+			});
+		});
+
+		bool in_string = false;
+		int64_t depth = 0;
+		for (auto& chunk: chunks)
+		{
+			chunk.in_string = in_string;
+			chunk.depth = depth;
+			depth += chunk.depth_change[in_string];
+			in_string ^= chunk.flips_string;
+		}
+
+		// The first chunk's piece starts after the opening bracket, at depth 1
+		_j_parallel_for(threads, chunks.size() - 1, [&](size_t i) {
+			Chunk& chunk = chunks[i + 1];
+			int64_t depth = chunk.depth;
+			scan(chunk, [&](size_t offset, bool in_string) {
+				if (in_string != chunk.in_string)
+					return true;
+				if (depth == 1 && input[offset] == ',')
+				{
+					chunk.split = offset;
+					return false;
+				}
+				depth += DEPTH_CHANGE[(uint8_t)input[offset]];
+				return true;
+			});
+		});
+
+		std::vector<size_t> bounds{open};
+		for (auto& chunk: chunks)
+			if (chunk.split != SIZE_MAX)
+				bounds.push_back(chunk.split);
+		bounds.push_back(close);
+
+		JSON_Token::KIND kind = input[open] == '[' ? JSON_Token::T_lbracket : JSON_Token::T_lbrace;
+		std::vector<Piece> pieces(bounds.size() - 1);
+		_j_parallel_for(threads, pieces.size(), [&](size_t i) {
+			pieces[i] = parse_piece<TParser>(bounds[i] + 1, bounds[i + 1], kind);
+		});
+
+		J_Parse_Result result{};
+		size_t count = 0;
+		for (auto& piece: pieces)
+		{
+			if (result.err == nullptr && piece.err)
+				result.err = piece.err.err.data();
+
+			// Pieces are cut on commas, so each one has a value
+			size_t piece_count = kind == JSON_Token::T_lbracket ? piece.json.as_array.count : piece.json.as_object.count;
+			if (result.err == nullptr && piece_count == 0 && pieces.size() > 1)
+				result.err = "Unexpected terminal";
+			count += piece_count;
+		}
+
+		if (result.err)
+		{
+			for (auto& piece: pieces)
+				if (piece.err == false)
+					j_free(piece.json);
+			return result;
+		}
+
+		// Moves the pieces' values into one block, the values themselves stay where they are
+		bool array = kind == JSON_Token::T_lbracket;
+		size_t item_size = array ? sizeof(J_JSON) : sizeof(J_Pair);
+		char* items = array ? (char*)j_malloc(count * item_size) : (char*)_j_allocate_pairs(count, nullptr);
+		char* it = items;
+		for (auto& piece: pieces)
+		{
+			void* block = array ? (void*)piece.json.as_array.ptr : (void*)piece.json.as_object.pairs;
+			size_t bytes = (array ? piece.json.as_array.count : piece.json.as_object.count) * item_size;
+			if (bytes > 0)
+				::memcpy(it, block, bytes);
+			it += bytes;
+			if (array)
+				::free(block);
+			else
+				_j_free_pairs(piece.json.as_object);
+		}
+
+		if (kind == JSON_Token::T_lbracket)
+			result.json = J_JSON{.kind = J_JSON_ARRAY, .as_array = {(J_JSON*)items, count}};
+		else
+			result.json = J_JSON{.kind = J_JSON_OBJECT, .as_object = {(J_Pair*)items, count}};
+		return result;
+	}
+};
+
+// Builds a malloc'd tree, or into `document` which then keeps the interned keys
+J_Parse_Result
+_j_parse_json(const char* json_string, size_t size, J_Parse_Options options, J_Document* document)
+{
+	options = resolve_options(options);
+
+	// Pieces are built by builders of their own, which don't share an arena
+	if (options.threads > 1 && document == nullptr)
+	{
+		Parallel_Parse parallel{std::string_view{json_string, size}, options};
+		std::optional<J_Parse_Result> result;
+		if (options.engine == J_PARSE_ENGINE_TABLE)
+			result = parallel.parse<Parser<JSON_Builder>>(options.threads);
+		else if (options.engine == J_PARSE_ENGINE_STATE_MACHINE)
+			result = parallel.parse<State_Machine_Parser<JSON_Builder>>(options.threads);
+		if (result)
+			return *result;
+	}
+
+	JSON_Builder builder{options, document ? &document->arena : nullptr};
+	if (auto err = _j_parse_with_options(json_string, size, options, builder))
+		return {J_JSON{}, err.err.data()};
+
+	if (document)
+		document->keys.swap(builder._keys);
+	return {builder.yield()};
+}
+
+J_Parse_Result
+j_parse_with_options(const char* json_string, size_t size, J_Parse_Options options)
+{
+	return _j_parse_json(json_string, size, options, nullptr);
+}
+
+J_Document_Result
+j_parse_document(const char* json_string, size_t size, J_Parse_Options options)
+{
+	J_Document* document = new (j_malloc(sizeof(J_Document))) J_Document{};
+	J_Parse_Result result = _j_parse_json(json_string, size, options, document);
+	if (result.err)
+	{
+		j_document_free(document);
+		return {nullptr, J_JSON{}, result.err};
+	}
+	return {document, result.json};
+}
+
+void
+j_document_free(J_Document* document)
+{
+	if (document == nullptr)
+		return;
+
+	document->~J_Document();
+	::free(document);
+}
+
+J_String
+j_document_key(const J_Document* document, const char* key)
+{
+	size_t count = ::strlen(key);
+	return document->keys.find(key, count, Key_Interner::hash(key, count));
+}
+
+J_JSON*
+j_object_find_interned(J_Object object, J_String key)
+{
+	for (size_t i = 0; i < object.count; i++)
+		if (object.pairs[i].key == key)
+			return &object.pairs[i].value;
+	return nullptr;
+}
+
+// Index of a large object, built on first use. Readers racing on the first lookup each build an
+// index, one of them is kept.
+static Object_Index*
+_j_object_index(J_Object object)
+{
+	Object_Header* header = _j_object_header(object);
+	Object_Index* index = header->index.load(std::memory_order_acquire);
+	if (index == nullptr)
+	{
+		Object_Index* built = Object_Index::build(object);
+		if (header->index.compare_exchange_strong(index, built, std::memory_order_acq_rel))
+		{
+			index = built;
+			if (header->document)
+				header->document->adopt(&index->link);
+		}
+		else
+		{
+			::free(built);
+		}
+	}
+	return index;
+}
+
+// `hash` is Object_Index::hash of the key, only large objects need it
+static inline J_JSON*
+_j_object_find(J_Object object, const char* key, size_t size, uint64_t hash)
+{
+	if (object.count < OBJECT_INDEX_MIN_COUNT)
+	{
+		for (size_t i = 0; i < object.count; i++)
+			if (Object_Index::key_equal(object.pairs[i].key, key, size))
+				return &object.pairs[i].value;
+		return nullptr;
+	}
+
+	uint64_t* slot = _j_object_index(object)->find(object.pairs, key, size, hash);
+	if (*slot == 0)
+		return nullptr;
+	return &object.pairs[uint32_t(*slot) - 1].value;
+}
+
+J_JSON*
+j_object_get(J_Object object, const char* key, size_t size)
+{
+	uint64_t hash = object.count < OBJECT_INDEX_MIN_COUNT ? 0 : Object_Index::hash(key, size);
+	return _j_object_find(object, key, size, hash);
+}
+
+// A compiled JSON Pointer: the reference tokens unescaped, hashed for j_object_get's index, and
+// parsed as array indices where they can be one. One block holds the segments and the keys.
+struct J_Pointer
+{
+	struct Segment
+	{
+		const char* key;
+		size_t size;
+		uint64_t hash;
+		size_t index; // SIZE_MAX unless the token is an array index
+	};
+
+	size_t count;
+
+	Segment*
+	segments()
+	{
+		return (Segment*)(this + 1);
+	}
+};
+
+J_Pointer_Result
+j_pointer_compile(const char* pointer, size_t size)
+{
+	if (size > 0 && pointer[0] != '/')
+		return {nullptr, "Pointer must start with '/'"};
+
+	size_t count = 0;
+	for (size_t i = 0; i < size; i++)
+	{
+		if (pointer[i] == '/')
+			count++;
+		else if (pointer[i] == '~' && (i + 1 == size || (pointer[i + 1] != '0' && pointer[i + 1] != '1')))
+			return {nullptr, "Invalid escape in pointer"};
+	}
+
+	// Unescaping never makes a token longer, the keys fit in `size` bytes
+	J_Pointer* compiled = (J_Pointer*)j_malloc(sizeof(J_Pointer) + count * sizeof(J_Pointer::Segment) + size);
+	compiled->count = count;
+	char* out = (char*)(compiled->segments() + count);
+
+	const char* it = pointer;
+	const char* end = pointer + size;
+	for (size_t i = 0; i < count; i++)
+	{
+		it++; // '/'
+		J_Pointer::Segment& segment = compiled->segments()[i];
+		segment.key = out;
+		for (; it != end && *it != '/'; it++)
+		{
+			if (*it == '~')
+				*out++ = *++it == '0' ? '~' : '/';
+			else
+				*out++ = *it;
+		}
+		segment.size = out - segment.key;
+		segment.hash = Object_Index::hash(segment.key, segment.size);
+
+		// Digits without a leading zero, "-" (past the end) never matches an element
+		segment.index = SIZE_MAX;
+		bool digits = segment.size > 0 && (segment.size == 1 || segment.key[0] != '0');
+		for (size_t j = 0; j < segment.size && digits; j++)
+			digits = segment.key[j] >= '0' && segment.key[j] <= '9';
+		if (digits)
+		{
+			size_t index = 0;
+			auto [_, ec] = std::from_chars(segment.key, segment.key + segment.size, index);
+			if (ec == std::errc{})
+				segment.index = index;
+		}
+	}
+	return {compiled};
+}
+
+void
+j_pointer_free(J_Pointer* pointer)
+{
+	::free(pointer);
+}
+
+J_JSON*
+j_pointer_eval(J_JSON* root, const J_Pointer* pointer)
+{
+	J_JSON* json = root;
+	const J_Pointer::Segment* segments = (const J_Pointer::Segment*)(pointer + 1);
+	for (size_t i = 0; i < pointer->count && json; i++)
+	{
+		const J_Pointer::Segment& segment = segments[i];
+		switch (json->kind)
+		{
+		case J_JSON_OBJECT:
+			json = _j_object_find(json->as_object, segment.key, segment.size, segment.hash);
+			break;
+
+		case J_JSON_ARRAY:
+			json = segment.index < json->as_array.count ? json->as_array.ptr + segment.index : nullptr;
+			break;
+
+		default:
+			return nullptr;
+		}
+	}
+	return json;
+}
+
+// A compiled query is a chain of states, one per selector: the children of a value in state i
+// that the selector matches move to state i + 1, and values that get past the last selector are
+// the matches. Without descendant selectors every value is in at most one state.
+struct J_Query
+{
+	enum KIND
+	{
+		KIND_NAME,
+		KIND_WILDCARD,
+		KIND_SLICE,  // an index n is the slice n:n+1
+		KIND_FILTER,
+	};
+
+	enum OP
+	{
+		OP_EXISTS,
+		OP_EQ,
+		OP_NE,
+		OP_LT,
+		OP_LE,
+		OP_GT,
+		OP_GE,
+	};
+
+	struct Literal
+	{
+		JSON_Token::KIND kind; // T_number, T_string, T_true, T_false or T_null
+		double number;
+		std::string string;
+	};
+
+	struct Filter
+	{
+		std::vector<std::string> path; // member names after '@'
+		OP op;
+		Literal literal;
+	};
+
+	struct Selector
+	{
+		KIND kind = KIND_NAME;
+		std::string name;
+		size_t start = 0, end = SIZE_MAX, step = 1;
+		Filter filter;
+	};
+
+	std::vector<Selector> selectors;
+
+	// Whether the scalar `token` compares to `literal` as `op` says. Values of different kinds are
+	// only ever unequal, and only numbers and strings are ordered.
+	static bool
+	compare(const JSON_Token& token, OP op, const Literal& literal)
+	{
+		if (token.kind() != literal.kind)
+			return op == OP_NE;
+
+		int order = 0;
+		bool ordered = true;
+		switch (token.kind())
+		{
+		case JSON_Token::T_number: {
+			double number = Number::parse(token.data()).to_double();
+			order = (number > literal.number) - (number < literal.number);
+			break;
+		}
+
+		case JSON_Token::T_string: {
+			String_View raw = token.data();
+			std::string decoded(raw.count, '\0');
+			decoded.resize(String_Arena::unescape(raw, decoded.data()));
+			int c = decoded.compare(literal.string);
+			order = (c > 0) - (c < 0);
+			break;
+		}
+
+		default:
+			ordered = false;
+			break;
+		}
+
+		switch (op)
+		{
+		case OP_EQ: return order == 0;
+		case OP_NE: return order != 0;
+		case OP_LT: return ordered && order < 0;
+		case OP_LE: return order <= 0;
+		case OP_GT: return ordered && order > 0;
+		case OP_GE: return order >= 0;
+		default: return false;
+		}
+	}
+};
+
+struct Query_Compiler
+{
+	std::string_view _path;
+	size_t _it;
+
+	inline char
+	peek() const
+	{
+		return _it < _path.size() ? _path[_it] : '\0';
+	}
+
+	inline bool
+	eat(char c)
+	{
+		if (peek() != c)
+			return false;
+		_it++;
+		return true;
+	}
+
+	inline void
+	skip_spaces()
+	{
+		while (peek() == ' ' || peek() == '\t' || peek() == '\n' || peek() == '\r')
+			_it++;
+	}
+
+	// The shorthand after '.': letters, digits, '_', '-' and any non-ASCII byte
+	Error
+	name(std::string& name)
+	{
+		size_t begin = _it;
+		for (char c = peek(); ::isalnum((uint8_t)c) || c == '_' || c == '-' || (uint8_t)c >= 0x80; c = peek())
+			_it++;
+		if (_it == begin)
+			return Error{peek() == '.' ? "Descendant selectors are not supported" : "Expected a name"};
+		name.assign(_path.substr(begin, _it - begin));
+		return Error{};
+	}
+
+	// 'name' or "name", a backslash takes the next character as is
+	Error
+	quoted(std::string& string)
+	{
+		char quote = _path[_it++];
+		while (true)
+		{
+			if (_it == _path.size())
+				return Error{"Unterminated string"};
+			char c = _path[_it++];
+			if (c == quote)
+				return Error{};
+			if (c == '\\')
+			{
+				if (_it == _path.size())
+					return Error{"Unterminated string"};
+				c = _path[_it++];
+			}
+			string += c;
+		}
+	}
+
+	// `present` is false when there are no digits, as in the bounds a slice leaves out
+	Error
+	index(size_t& value, bool& present)
+	{
+		skip_spaces();
+		if (peek() == '-')
+			return Error{"Negative indices are not supported"};
+
+		size_t begin = _it;
+		while (peek() >= '0' && peek() <= '9')
+			_it++;
+		present = _it > begin;
+		if (present == false)
+			return Error{};
+
+		auto [_, ec] = std::from_chars(_path.data() + begin, _path.data() + _it, value);
+		if (ec != std::errc{})
+			return Error{"Index too large"};
+		skip_spaces();
+		return Error{};
+	}
+
+	Error
+	slice(J_Query::Selector& selector)
+	{
+		bool present = false;
+		if (auto err = index(selector.start, present))
+			return err;
+		if (eat(':') == false)
+		{
+			if (present == false)
+				return Error{"Invalid selector"};
+			selector.end = selector.start + 1;
+			return Error{};
+		}
+
+		if (auto err = index(selector.end, present))
+			return err;
+		if (present == false)
+			selector.end = SIZE_MAX;
+		if (eat(':') == false)
+			return Error{};
+
+		if (auto err = index(selector.step, present))
+			return err;
+		if (present == false)
+			selector.step = 1;
+		if (selector.step == 0)
+			return Error{"Slice step must be positive"};
+		return Error{};
+	}
+
+	Error
+	literal(J_Query::Literal& literal)
+	{
+		if (peek() == '\'' || peek() == '"')
+		{
+			literal.kind = JSON_Token::T_string;
+			return quoted(literal.string);
+		}
+
+		size_t begin = _it;
+		while (::isalnum((uint8_t)peek()) || peek() == '-' || peek() == '+' || peek() == '.')
+			_it++;
+		std::string_view word = _path.substr(begin, _it - begin);
+
+		if (word == "true")
+			literal.kind = JSON_Token::T_true;
+		else if (word == "false")
+			literal.kind = JSON_Token::T_false;
+		else if (word == "null")
+			literal.kind = JSON_Token::T_null;
+		else
+		{
+			literal.kind = JSON_Token::T_number;
+			auto [end, ec] = std::from_chars(word.data(), word.data() + word.size(), literal.number);
+			if (word.empty() || ec != std::errc{} || end != word.data() + word.size())
+				return Error{"Invalid literal"};
+		}
+		return Error{};
+	}
+
+	// After "?": "@", member names, then an optional comparison, in optional parentheses
+	Error
+	filter(J_Query::Filter& filter)
+	{
+		skip_spaces();
+		bool parenthesized = eat('(');
+		skip_spaces();
+		if (eat('@') == false)
+			return Error{"Filters must start with '@'"};
+
+		while (eat('.'))
+		{
+			filter.path.emplace_back();
+			if (auto err = name(filter.path.back()))
+				return err;
+		}
+		skip_spaces();
+
+		static constexpr std::pair<std::string_view, J_Query::OP> OPS[] = {
+			{"==", J_Query::OP_EQ}, {"!=", J_Query::OP_NE}, {"<=", J_Query::OP_LE},
+			{">=", J_Query::OP_GE}, {"<", J_Query::OP_LT}, {">", J_Query::OP_GT},
+		};
+		filter.op = J_Query::OP_EXISTS;
+		for (auto [text, op]: OPS)
+		{
+			if (_path.substr(_it).starts_with(text))
+			{
+				filter.op = op;
+				_it += text.size();
+				break;
+			}
+		}
+
+		if (filter.op != J_Query::OP_EXISTS)
+		{
+			skip_spaces();
+			if (auto err = literal(filter.literal))
+				return err;
+			skip_spaces();
+		}
+
+		if (parenthesized && eat(')') == false)
+			return Error{"Expected ')'"};
+		return Error{};
+	}
+
+	Error
+	compile(J_Query& query)
+	{
+		if (eat('$') == false)
+			return Error{"Queries must start with '$'"};
+
+		while (_it < _path.size())
+		{
+			J_Query::Selector selector{};
+			if (eat('.'))
+			{
+				if (eat('*'))
+					selector.kind = J_Query::KIND_WILDCARD;
+				else if (auto err = name(selector.name))
+					return err;
+			}
+			else if (eat('['))
+			{
+				skip_spaces();
+				Error err{};
+				if (peek() == '\'' || peek() == '"')
+					err = quoted(selector.name);
+				else if (eat('*'))
+					selector.kind = J_Query::KIND_WILDCARD;
+				else if (eat('?'))
+					selector.kind = J_Query::KIND_FILTER, err = filter(selector.filter);
+				else
+					selector.kind = J_Query::KIND_SLICE, err = slice(selector);
+				if (err)
+					return err;
+
+				skip_spaces();
+				if (eat(']') == false)
+					return Error{"Expected ']'"};
+			}
+			else
+			{
+				return Error{"Expected '.' or '['"};
+			}
+			query.selectors.push_back(std::move(selector));
+		}
+		return Error{};
+	}
+};
+
+// Walks the input with a cursor reader: containers the query goes through are checked token by
+// token, values no selector matches are skipped, and matched values are parsed into the document
+template<typename TParser>
+struct Query_Run
+{
+	const J_Query& _query;
+	std::string_view _input;
+	Cursor_Reader _reader;
+	JSON_Builder _builder;
+	TParser _parser;
+	Scratch_Stack<J_JSON> _matches;
+
+	Query_Run(const J_Query& query, std::string_view input, const J_Parse_Options& options, Arena* document)
+		: _query(query), _input(input), _reader{input, 0}, _builder{options, document}, _parser{options, _builder}, _matches{}
+	{
+	}
+
+	// A value can't start on these, which skip() alone wouldn't notice
+	inline Error
+	check_value(size_t offset)
+	{
+		switch (_reader.at(offset))
+		{
+		case '\0':
+			return Error{"Incomplete"};
+
+		case ',': case ':': case ']': case '}':
+			return Error{"Unexpected terminal"};
+
+		default:
+			return Error{};
+		}
+	}
+
+	inline Error
+	skip(size_t offset)
+	{
+		if (auto err = check_value(offset))
+			return err;
+		return _reader.skip(offset);
+	}
+
+	// Member `name` of the object at `value` with a reader of the filter's, `found` is false if
+	// there's none or `value` isn't an object
+	static Error
+	field(Cursor_Reader& reader, size_t& value, const std::string& name, bool& found)
+	{
+		found = false;
+		if (reader.at(value) != '{')
+			return Error{};
+
+		JSON_Token token{};
+		while (true)
+		{
+			if (auto err = reader.next(token))
+				return err;
+			if (token.kind() == JSON_Token::T_rbrace)
+				return Error{};
+			if (token.kind() != JSON_Token::T_string)
+				return Error{"Unexpected terminal"};
+			bool match = Cursor_Reader::key_equals(token.data(), name.data(), name.size());
+
+			if (auto err = reader.next(token))
+				return err;
+			if (token.kind() != JSON_Token::T_colon)
+				return Error{"Unexpected terminal"};
+
+			size_t offset = reader.next_offset();
+			if (match)
+			{
+				value = offset;
+				found = true;
+				return Error{};
+			}
+
+			if (auto err = reader.skip(offset))
+				return err;
+			if (auto err = reader.next(token))
+				return err;
+			if (token.kind() == JSON_Token::T_rbrace)
+				return Error{};
+			if (token.kind() != JSON_Token::T_comma)
+				return Error{"Unexpected terminal"};
+		}
+	}
+
+	// Evaluates `filter` on the value at `offset` with a reader of its own, _reader stays on it
+	Error
+	test(size_t offset, const J_Query::Filter& filter, bool& matched)
+	{
+		Cursor_Reader reader{_input, offset};
+		size_t value = reader.next_offset();
+		bool found = true;
+		for (size_t i = 0; i < filter.path.size() && found; i++)
+			if (auto err = field(reader, value, filter.path[i], found))
+				return err;
+
+		if (filter.op == J_Query::OP_EXISTS)
+		{
+			matched = found;
+			return Error{};
+		}
+
+		// Literals are scalars, a missing value or a container only ever differs from them
+		if (found == false || reader.at(value) == '[' || reader.at(value) == '{')
+		{
+			matched = filter.op == J_Query::OP_NE;
+			return Error{};
+		}
+
+		JSON_Token token{};
+		if (auto err = reader.token(value, token))
+			return err;
+		matched = J_Query::compare(token, filter.op, filter.literal);
+		return Error{};
+	}
+
+	// Feeds the value at `offset` to the parser, so that matches are checked like j_parse's
+	Error
+	build(size_t offset)
+	{
+		_parser.reset();
+		_builder.reset(_builder._document);
+
+		size_t depth = 0;
+		JSON_Token token{};
+		while (true)
+		{
+			if (auto err = _reader.token(offset, token))
+				return err;
+			if (auto err = _parser.feed(token))
+				return err;
+
+			if (token.kind() == JSON_Token::T_lbracket || token.kind() == JSON_Token::T_lbrace)
+				depth++;
+			else if (token.kind() == JSON_Token::T_rbracket || token.kind() == JSON_Token::T_rbrace)
+				depth--;
+			if (depth == 0)
+				break;
+			offset = _reader.next_offset();
+		}
+
+		if (auto err = _parser.feed(JSON_Token{JSON_Token::META_END_OF_INPUT}))
+			return err;
+		_matches.push(_builder.yield());
+		return Error{};
+	}
+
+	Error
+	walk_object(const J_Query::Selector& selector, size_t state)
+	{
+		JSON_Token token{};
+		size_t offset = _reader.next_offset();
+		if (_reader.at(offset) == '}')
+			return Error{};
+
+		while (true)
+		{
+			if (auto err = _reader.token(offset, token))
+				return err;
+			if (token.kind() != JSON_Token::T_string)
+				return Error{"Unexpected terminal"};
+			String_View key = token.data();
+
+			if (auto err = _reader.next(token))
+				return err;
+			if (token.kind() != JSON_Token::T_colon)
+				return Error{"Unexpected terminal"};
+
+			size_t value = _reader.next_offset();
+			bool match = selector.kind == J_Query::KIND_WILDCARD;
+			if (selector.kind == J_Query::KIND_NAME)
+				match = Cursor_Reader::key_equals(key, selector.name.data(), selector.name.size());
+			else if (selector.kind == J_Query::KIND_FILTER)
+				if (auto err = test(value, selector.filter, match))
+					return err;
+
+			if (auto err = match ? walk(value, state + 1) : skip(value))
+				return err;
+
+			if (auto err = _reader.next(token))
+				return err;
+			if (token.kind() == JSON_Token::T_rbrace)
+				return Error{};
+			if (token.kind() != JSON_Token::T_comma)
+				return Error{"Unexpected terminal"};
+			offset = _reader.next_offset();
+		}
+	}
+
+	Error
+	walk_array(const J_Query::Selector& selector, size_t state)
+	{
+		size_t offset = _reader.next_offset();
+		if (_reader.at(offset) == ']')
+			return Error{};
+
+		for (size_t index = 0;; index++)
+		{
+			bool match = selector.kind == J_Query::KIND_WILDCARD;
+			if (selector.kind == J_Query::KIND_SLICE)
+				match = index >= selector.start && index < selector.end && (index - selector.start) % selector.step == 0;
+			else if (selector.kind == J_Query::KIND_FILTER)
+				if (auto err = test(offset, selector.filter, match))
+					return err;
+
+			if (auto err = match ? walk(offset, state + 1) : skip(offset))
+				return err;
+
+			JSON_Token token{};
+			if (auto err = _reader.next(token))
+				return err;
+			if (token.kind() == JSON_Token::T_rbracket)
+				return Error{};
+			if (token.kind() != JSON_Token::T_comma)
+				return Error{"Unexpected terminal"};
+			offset = _reader.next_offset();
+		}
+	}
+
+	// The value at `offset` has matched every selector before `state`
+	Error
+	walk(size_t offset, size_t state)
+	{
+		if (auto err = check_value(offset))
+			return err;
+		if (state == _query.selectors.size())
+			return build(offset);
+
+		const J_Query::Selector& selector = _query.selectors[state];
+		char c = _reader.at(offset);
+		if (c == '{' && selector.kind != J_Query::KIND_SLICE)
+			return walk_object(selector, state);
+		if (c == '[' && selector.kind != J_Query::KIND_NAME)
+			return walk_array(selector, state);
+		return _reader.skip(offset);
+	}
+
+	Error
+	run()
+	{
+		ZoneScoped;
+
+		if (auto err = walk(_reader.next_offset(), 0))
+			return err;
+		if (_reader.next_offset() != _input.size())
+			return Error{"Trailing characters"};
+		return Error{};
+	}
+};
+
+J_Query_Compile_Result
+j_query_compile(const char* path, size_t size)
+{
+	J_Query* query = new (j_malloc(sizeof(J_Query))) J_Query{};
+	Query_Compiler compiler{std::string_view{path, size}, 0};
+	if (auto err = compiler.compile(*query))
+	{
+		j_query_free(query);
+		return {nullptr, err.err.data()};
+	}
+	return {query};
+}
+
+void
+j_query_free(J_Query* query)
+{
+	if (query == nullptr)
+		return;
+
+	query->~J_Query();
+	::free(query);
+}
+
+template<typename TParser>
+static Error
+_j_query(std::string_view input, const J_Query& query, const J_Parse_Options& options, J_Document* document, J_Query_Result& result)
+{
+	Query_Run<TParser> run{query, input, options, &document->arena};
+	if (auto err = run.run())
+		return err;
+
+	document->keys.swap(run._builder._keys);
+	result.count = run._matches.size();
+	if (result.count > 0)
+	{
+		result.values = (J_JSON*)document->arena.allocate(result.count * sizeof(J_JSON));
+		::memcpy(result.values, run._matches.data(), result.count * sizeof(J_JSON));
+	}
+	return Error{};
+}
+
+J_Query_Result
+j_query(const char* json_string, size_t size, const J_Query* query, J_Parse_Options options)
+{
+	options = resolve_options(options);
+
+	J_Query_Result result{.document = new (j_malloc(sizeof(J_Document))) J_Document{}};
+	std::string_view input{json_string, size};
+	Error err{"Invalid parse engine"};
+	if (options.engine == J_PARSE_ENGINE_TABLE)
+		err = _j_query<Parser<JSON_Builder>>(input, *query, options, result.document, result);
+	else if (options.engine == J_PARSE_ENGINE_STATE_MACHINE)
+		err = _j_query<State_Machine_Parser<JSON_Builder>>(input, *query, options, result.document, result);
+
+	if (err)
+	{
+		j_document_free(result.document);
+		return {nullptr, nullptr, 0, err.err.data()};
+	}
+	return result;
+}
+
+J_Tape_Result
+j_parse_tape(const char* json_string, size_t size, J_Parse_Options options)
+{
+	options = resolve_options(options);
+
+	J_Tape* tape = new (j_malloc(sizeof(J_Tape))) J_Tape{};
+	Tape_Builder builder{options, *tape};
+	if (auto err = _j_parse_with_options(json_string, size, options, builder))
+	{
+		j_tape_free(tape);
+		return {nullptr, err.err.data()};
+	}
+	return {tape};
+}
+
+void
+j_tape_free(J_Tape* tape)
+{
+	if (tape == nullptr)
+		return;
+
+	tape->~J_Tape();
+	::free(tape);
+}
+
+J_Tape_Value
+j_tape_root(const J_Tape* tape)
+{
+	return {tape, 0};
+}
+
+J_JSON_KIND
+j_tape_kind(J_Tape_Value value)
+{
+	switch (J_Tape::tag(value.tape->words._items[value.index]))
+	{
+	case J_Tape::TAG_NULL:        return J_JSON_NULL;
+	case J_Tape::TAG_TRUE:        return J_JSON_BOOL;
+	case J_Tape::TAG_FALSE:       return J_JSON_BOOL;
+	case J_Tape::TAG_NUMBER:      return J_JSON_NUMBER;
+	case J_Tape::TAG_NUMBER_TEXT: return J_JSON_NUMBER;
+	case J_Tape::TAG_STRING:      return J_JSON_STRING;
+	case J_Tape::TAG_ARRAY:       return J_JSON_ARRAY;
+	case J_Tape::TAG_OBJECT:      return J_JSON_OBJECT;
+	default:
+		unreachable("Not the start of a value");
+		return J_JSON_NULL;
+	}
+}
+
+J_Bool
+j_tape_get_bool(J_Tape_Value value)
+{
+	assert(j_tape_kind(value) == J_JSON_BOOL);
+	return J_Tape::tag(value.tape->words._items[value.index]) == J_Tape::TAG_TRUE;
+}
+
+J_Number
+j_tape_get_number(J_Tape_Value value)
+{
+	assert(j_tape_kind(value) == J_JSON_NUMBER);
+	const uint64_t* words = value.tape->words._items + value.index;
+	if (J_Tape::tag(words[0]) == J_Tape::TAG_NUMBER_TEXT)
+		return Number::parse(String_View{(const char*)uintptr_t(words[1]), J_Tape::payload(words[0])}).to_double();
+	return std::bit_cast<double>(words[1]);
+}
+
+J_String
+j_tape_get_string(J_Tape_Value value)
+{
+	assert(j_tape_kind(value) == J_JSON_STRING);
+	return (J_String)uintptr_t(J_Tape::payload(value.tape->words._items[value.index]));
+}
+
+size_t
+j_tape_count(J_Tape_Value value)
+{
+	assert(j_tape_kind(value) == J_JSON_ARRAY || j_tape_kind(value) == J_JSON_OBJECT);
+	size_t end = J_Tape::payload(value.tape->words._items[value.index]) - 1;
+	return J_Tape::payload(value.tape->words._items[end]);
+}
+
+J_Tape_Value
+j_tape_skip(J_Tape_Value value)
+{
+	return {value.tape, value.tape->skip(value.index)};
+}
+
+J_Tape_Iterator
+j_tape_iterate(J_Tape_Value container)
+{
+	assert(j_tape_kind(container) == J_JSON_ARRAY || j_tape_kind(container) == J_JSON_OBJECT);
+	J_Tape_Iterator it{};
+	it.key = it.value = {container.tape, 0};
+	it._next = container.index + 1;
+	it._end = J_Tape::payload(container.tape->words._items[container.index]) - 1;
+	return it;
+}
+
+bool
+j_tape_next(J_Tape_Iterator* it)
+{
+	if (it->_next == it->_end)
+		return false;
+
+	const J_Tape* tape = it->value.tape;
+	if (J_Tape::tag(tape->words._items[it->_end]) == J_Tape::TAG_OBJECT_END)
+	{
+		it->key = {tape, it->_next};
+		it->_next++;
+	}
+	it->value = {tape, it->_next};
+	it->_next = tape->skip(it->_next);
+	return true;
+}
+
+const char*
+j_parse_sax(const char* json_string, size_t size, const J_Sax_Callbacks* callbacks, void* user)
+{
+	J_Parse_Options options = resolve_options(J_Parse_Options{});
+
+	Sax_Builder builder{options, *callbacks, user};
+	if (auto err = _j_parse_with_options(json_string, size, options, builder))
+		return err.err.data();
+	return nullptr;
+}
+
+// Engine and builder state persist between chunks, the lexer doesn't: every chunk gets a lexer of
+// its own, and a token cut off at a chunk's end is moved to `pending` and lexed again from its
+// first byte once more input arrives
+struct J_Parser
+{
+	J_Parse_Options options;
+	JSON_Builder builder;
+	std::optional<Parser<JSON_Builder>> table;
+	std::optional<State_Machine_Parser<JSON_Builder>> state_machine;
+	Scratch_Stack<char> pending;
+	Error err;
+
+	J_Parser(const J_Parse_Options& options) : options(options), builder{options, nullptr}, err{}
+	{
+		if (options.engine == J_PARSE_ENGINE_STATE_MACHINE)
+			state_machine.emplace(options, builder);
+		else if (options.engine == J_PARSE_ENGINE_TABLE)
+			table.emplace(options, builder);
+		else
+			err = Error{"Invalid parse engine"};
+	}
+
+	// Lexes `input` and feeds its tokens to the engine, up to a token cut off at the end unless
+	// `last` says no more input follows. Returns how many bytes were consumed.
+	template<typename TParser>
+	Result<size_t>
+	lex(TParser& parser, std::string_view input, bool last)
+	{
+		Lexer lexer{input};
+		lexer._chunked = last == false;
+
+		JSON_Token token{};
+		while (true)
+		{
+			if (auto err = lexer.next(token))
+			{
+				if (err.err.data() == Lexer::INCOMPLETE)
+					return lexer._incomplete;
+				return err;
+			}
+
+			if (token.kind() == JSON_Token::META_END_OF_INPUT && last == false)
+				return input.size();
+
+			if (auto err = parser.feed(token))
+				return err;
+
+			if (token.kind() == JSON_Token::META_END_OF_INPUT)
+				return input.size();
+		}
+	}
 
-		return false;
+	Result<size_t>
+	lex(std::string_view input, bool last)
+	{
+		if (table)
+			return lex(*table, input, last);
+		return lex(*state_machine, input, last);
 	}
 
-	inline Result<bool>
-	try_to_scan_multichar_terminal(String_View str, Rune rune, std::span<const std::pair<STATE, Rune>> table, JSON_Token::KIND kind)
+	Error
+	feed(const char* chunk, size_t size, bool last)
 	{
 		ZoneScoped;
 
-		auto state = _state_stack.top();
+		if (err)
+			return err;
 
-		if (auto [first_state, expected] = table.front(); state == first_state)
+		std::string_view input{chunk, size};
+		bool from_pending = pending.size() > 0;
+		if (from_pending)
 		{
-			if (rune != expected) return false;
-
-			auto [next_state, _] = table[1];
-			_state_stack.push(next_state);
-			return true;
+			// Nothing but a quote can end a pending string, so long strings are only lexed again
+			// once one arrives
+			bool in_string = pending.data()[0] == '"';
+			pending.append(chunk, size);
+			if (in_string && last == false && (size == 0 || ::memchr(chunk, '"', size) == nullptr))
+				return Error{};
+
+			input = std::string_view{pending.data(), pending.size()};
 		}
 
-		if (auto [last_state, expected] = table.back(); state == last_state)
+		auto [consumed, lex_err] = lex(input, last);
+		if (lex_err)
+			return err = lex_err;
+
+		size_t left = input.size() - consumed;
+		if (from_pending)
 		{
-			if (rune != expected)
-				return Error{"Unexpected terminal"};
-			_state_stack.pop();
-			_tokens.emplace_back(kind);
-			return true;
+			::memmove(pending.data(), pending.data() + consumed, left);
+			pending.truncate(left);
 		}
-
-		for (size_t i = 1; i < table.size() - 1; i++)
+		else
 		{
-			auto [middle_state, expected] = table[i];
-			auto [next_state, _] = table[i + 1];
-
-			if (state == middle_state)
-			{
-				if (rune != expected)
-					return Error{"Unexpected terminal"};
-				_state_stack.top() = next_state;
-				return true;
-			}
+			pending.append(input.data() + consumed, left);
 		}
-		return false;
+		return Error{};
 	}
+};
 
-	inline Result<bool>
-	try_to_scan_true(String_View str, Rune rune)
-	{
-		std::pair<STATE, Rune> table[]{
-			{STATE_0, 't'},
-			{STATE_T, 'r'},
-			{STATE_TR, 'u'},
-			{STATE_TRU, 'e'},
-		};
+J_Parser*
+j_parser_new(J_Parse_Options options)
+{
+	options = resolve_options(options);
+	options.mode = J_PARSE_MODE_STREAMING;
+	options.lazy_numbers = false; // the text would point into a chunk
 
-		return try_to_scan_multichar_terminal(str, rune, table, JSON_Token::T_true);
-	}
+	return new (j_malloc(sizeof(J_Parser))) J_Parser{options};
+}
 
-	inline Result<bool>
-	try_to_scan_false(String_View str, Rune rune)
-	{
-		std::pair<STATE, Rune> table[]{
-			{STATE_0, 'f'},
-			{STATE_F, 'a'},
-			{STATE_FA, 'l'},
-			{STATE_FAL, 's'},
-			{STATE_FALS, 'e'},
-		};
+const char*
+j_parser_feed(J_Parser* parser, const char* chunk, size_t size)
+{
+	if (auto err = parser->feed(chunk, size, false))
+		return err.err.data();
+	return nullptr;
+}
 
-		return try_to_scan_multichar_terminal(str, rune, table, JSON_Token::T_false);
-	}
+J_Parse_Result
+j_parser_finish(J_Parser* parser)
+{
+	J_Parse_Result result{};
+	if (auto err = parser->feed(nullptr, 0, true))
+		result.err = err.err.data();
+	else
+		result.json = parser->builder.yield();
+
+	parser->~J_Parser();
+	::free(parser);
+	return result;
+}
 
-	inline Result<bool>
-	try_to_scan_null(String_View str, Rune rune)
-	{
-		std::pair<STATE, Rune> table[]{
-			{STATE_0, 'n'},
-			{STATE_N, 'u'},
-			{STATE_NU, 'l'},
-			{STATE_NUL, 'l'},
-		};
+// j_parse_many cuts the input into batches of whole lines. Workers parse a batch into the slot it
+// maps to, and the calling thread hands the results out in input order. A slot is only reused once
+// its results were handed out, which bounds the memory to two batches per worker.
+struct Many_Parse
+{
+	static constexpr size_t BATCH_SIZE = 1024 * 1024;
 
-		return try_to_scan_multichar_terminal(str, rune, table, JSON_Token::T_null);
-	}
+	struct Record
+	{
+		size_t line; // in the batch
+		J_Parse_Result result;
+	};
 
-	inline bool
-	continue_scan_number(String_View str)
+	struct Slot
 	{
-		ZoneScoped;
-		if (_terminal_builder.ptr == nullptr)
-			_terminal_builder.ptr = str.ptr;
+		Arena arena;
+		Scratch_Stack<Record> records;
+		size_t lines;
+		size_t batch; // the batch the slot holds, or waits for
+		bool done;
+	};
 
-		_terminal_builder.count++;
-		return true;
-	}
+	std::string_view input;
+	J_Parse_Options options;
+	std::vector<size_t> batch_ends;
+	std::vector<Slot> slots;
 
-	inline bool
-	end_scan_number()
-	{
-		ZoneScoped;
-		_state_stack.pop();
-		_tokens.emplace_back(JSON_Token::T_number, _terminal_builder);
-		_terminal_builder = {};
-		return false;
-	}
+	std::atomic<size_t> next_batch;
+	std::mutex mutex;
+	std::condition_variable slot_done;
+	std::condition_variable slot_free;
+	bool stop;
 
-	inline bool
-	continue_scan_string(String_View view)
+	Many_Parse(std::string_view input, const J_Parse_Options& options, size_t threads)
+		: input(input), options(options), slots(2 * threads), next_batch(0), stop(false)
 	{
-		ZoneScoped;
-		if (_terminal_builder.ptr == nullptr)
-			_terminal_builder.ptr = view.ptr;
+		for (size_t begin = 0; begin < input.size();)
+		{
+			size_t end = std::min(begin + BATCH_SIZE, input.size());
+			if (const char* newline = (const char*)::memchr(input.data() + end - 1, '\n', input.size() - end + 1))
+				end = newline - input.data() + 1;
+			else
+				end = input.size();
+			batch_ends.push_back(end);
+			begin = end;
+		}
 
-		_terminal_builder.count += view.count;
-		return true;
+		for (size_t i = 0; i < slots.size(); i++)
+			slots[i].batch = i;
 	}
 
-	inline bool
-	end_scan_string()
+	// Each worker keeps one builder and engine for all of its records
+	template<typename TParser>
+	void
+	work()
 	{
-		ZoneScoped;
-		_state_stack.pop();
-		_tokens.emplace_back(JSON_Token::T_string, _terminal_builder);
-		_terminal_builder = {};
-		return true;
-	}
+		JSON_Builder builder{options, nullptr};
+		TParser parser{options, builder};
 
-	inline Result<bool>
-	try_to_scan_number(String_View str, Rune rune)
-	{
-		ZoneScoped;
-		switch (auto state_top = _state_stack.top())
+		while (true)
 		{
-		case STATE_0: {
-			if (rune == '-')
+			size_t batch = next_batch.fetch_add(1);
+			if (batch >= batch_ends.size())
+				return;
+
+			Slot& slot = slots[batch % slots.size()];
 			{
-				_state_stack.push(STATE_NUMBER_MINUS);
-				return continue_scan_number(str);
+				std::unique_lock lock{mutex};
+				slot_free.wait(lock, [&] { return stop || slot.batch == batch; });
+				if (stop)
+					return;
 			}
 
-			if (is_digit(rune) == false) return false;
-
-			_state_stack.push(rune == '0' ? STATE_NUMBER_INTEGER_LEADING_ZERO : STATE_NUMBER_INTEGER);
-			return continue_scan_number(str);
-		}
-		case STATE_NUMBER_MINUS: {
-			if (is_digit(rune) == false) return Error{"Invalid character in number"};
-
-			_state_stack.top() = rune == '0' ? STATE_NUMBER_INTEGER_LEADING_ZERO : STATE_NUMBER_INTEGER;
-			return continue_scan_number(str);
-		}
-		case STATE_NUMBER_INTEGER_LEADING_ZERO:
-		case STATE_NUMBER_INTEGER: {
-			if (state_top == STATE_NUMBER_INTEGER_LEADING_ZERO && is_digit(rune))
-				return Error{"Leading zero"};
+			// Records of a batch share their keys
+			slot.arena.reset();
+			builder._keys.clear();
+			slot.records.truncate(0);
+			slot.lines = 0;
 
-			if (rune == '.')
+			size_t begin = batch > 0 ? batch_ends[batch - 1] : 0;
+			size_t end = batch_ends[batch];
+			while (begin < end)
 			{
-				_state_stack.top() = STATE_NUMBER_FRACTION;
-				return continue_scan_number(str);
+				const char* newline = (const char*)::memchr(input.data() + begin, '\n', end - begin);
+				size_t line_end = newline ? newline - input.data() : end;
+				std::string_view line = input.substr(begin, line_end - begin);
+				begin = line_end + 1;
+
+				// Blank lines separate nothing, they are skipped
+				if (line.empty() == false && line != "\r")
+				{
+					builder.reset(&slot.arena);
+					parser.reset();
+
+					Lexer lexer{line};
+					Record record{slot.lines};
+					if (auto err = _j_parse(lexer, parser, line.data(), options.mode))
+						record.result.err = err.err.data();
+					else
+						record.result.json = builder.yield();
+					slot.records.push(record);
+				}
+				slot.lines++;
 			}
-			if (rune == 'e' || rune == 'E')
+
 			{
-				_state_stack.top() = STATE_NUMBER_EXPONENT;
-				return continue_scan_number(str);
+				std::lock_guard lock{mutex};
+				slot.done = true;
 			}
-
-			return is_digit(rune) ? continue_scan_number(str) : end_scan_number();
+			slot_done.notify_all();
 		}
-		case STATE_NUMBER_FRACTION: {
-			if (is_digit(rune) == false) return Error{"Invalid fraction"};
+	}
 
-			_state_stack.top() = STATE_NUMBER_FRACTION_DIGITS;
-			return continue_scan_number(str);
-		}
-		case STATE_NUMBER_FRACTION_DIGITS: {
-			if (rune == 'e' || rune == 'E')
+	Error
+	deliver(J_Parse_Many_Callback callback, void* user)
+	{
+		size_t line = 0;
+		for (size_t batch = 0; batch < batch_ends.size(); batch++)
+		{
+			Slot& slot = slots[batch % slots.size()];
 			{
-				_state_stack.top() = STATE_NUMBER_EXPONENT;
-				return continue_scan_number(str);
+				std::unique_lock lock{mutex};
+				slot_done.wait(lock, [&] { return slot.done; });
 			}
 
-			return is_digit(rune) ? continue_scan_number(str) : end_scan_number();
-		}
-		case STATE_NUMBER_EXPONENT:
-		case STATE_NUMBER_EXPONENT_SIGN: {
-			if (state_top == STATE_NUMBER_EXPONENT && (rune == '-' || rune == '+'))
+			for (size_t i = 0; i < slot.records.size(); i++)
 			{
-				_state_stack.top() = STATE_NUMBER_EXPONENT_SIGN;
-				return continue_scan_number(str);
+				const Record& record = slot.records.data()[i];
+				if (callback(user, line + record.line, record.result) == false)
+				{
+					halt();
+					return Error{"Stopped by callback"};
+				}
 			}
+			line += slot.lines;
 
-			if (is_digit(rune) == false) return Error{"Invalid exponent"};
-
-			_state_stack.top() = STATE_NUMBER_EXPONENT_DIGITS;
-			return continue_scan_number(str);
-		}
-		case STATE_NUMBER_EXPONENT_DIGITS: {
-			return is_digit(rune) ? continue_scan_number(str) : end_scan_number();
-		}
-		default:
-			return false;
+			{
+				std::lock_guard lock{mutex};
+				slot.done = false;
+				slot.batch = batch + slots.size();
+			}
+			slot_free.notify_all();
 		}
+		return Error{};
 	}
 
-	inline Result<bool>
-	try_to_scan_character_in_string(String_View str, Rune rune)
+	void
+	halt()
 	{
-		ZoneScoped;
-		if (_state_stack.top() != STATE_STRING) return false;
-
-		if (rune == '"')
-			return end_scan_string();
-
-		if (Rune(0x20) <= rune && rune <= Rune(0x10ffff))
 		{
-			if (rune == '\\')
-				_state_stack.push(STATE_BACKSLASH);
-
-			return continue_scan_string(str);
+			std::lock_guard lock{mutex};
+			stop = true;
 		}
-
-		return Error{"Invalid unicode character"};
+		slot_free.notify_all();
 	}
+};
 
-	inline Result<bool>
-	try_to_scan_escaped_character(String_View str, Rune rune)
-	{
-		ZoneScoped;
-		if (_state_stack.top() != STATE_BACKSLASH) return false;
-		switch (rune)
-		{
-		case '"':
-		case '\\':
-		case '/':
-		case 'b':
-		case 'f':
-		case 'n':
-		case 'r':
-		case 't': {
-			_state_stack.pop();
-			return continue_scan_string(str);
-		}
+const char*
+j_parse_many(const char* json_string, size_t size, J_Parse_Options options, size_t threads, J_Parse_Many_Callback callback, void* user)
+{
+	ZoneScoped;
 
-		case 'u': {
-			_state_stack.top() = STATE_u;
-			return continue_scan_string(str);
-		}
+	options = resolve_options(options);
+	if (options.engine != J_PARSE_ENGINE_TABLE && options.engine != J_PARSE_ENGINE_STATE_MACHINE)
+		return "Invalid parse engine";
 
-		default:
-			return Error{"Invalid escaped character"};
-		}
-	}
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	Many_Parse many{std::string_view{json_string, size}, options, threads};
+	threads = std::min(threads, many.batch_ends.size());
 
-	inline Result<bool>
-	try_to_scan_escaped_unicode(String_View str, Rune rune)
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < threads; i++)
 	{
-		ZoneScoped;
-		switch (_state_stack.top())
-		{
-		case STATE_u:
-		case STATE_uX:
-		case STATE_uXX:
-		case STATE_uXXX:
-			if (is_hexdigit(rune) == false) return Error{"Invalid escaped unicode"};
+		if (options.engine == J_PARSE_ENGINE_TABLE)
+			workers.emplace_back([&] { many.work<Parser<JSON_Builder>>(); });
+		else
+			workers.emplace_back([&] { many.work<State_Machine_Parser<JSON_Builder>>(); });
+	}
 
-			_state_stack.top() = STATE(_state_stack.top() + 1);
-			if (_state_stack.top() == STATE_uXXXX)
-				_state_stack.pop();
+	Error err = many.deliver(callback, user);
+	for (auto& worker: workers)
+		worker.join();
 
-			return continue_scan_string(str);
+	if (err)
+		return err.err.data();
+	return nullptr;
+}
 
-		default:
-			return false;
-		}
-	}
+J_Doc*
+j_doc_open(const char* json_string, size_t size)
+{
+	return new (j_malloc(sizeof(J_Doc))) J_Doc{std::string_view{json_string, size}};
+}
 
-	inline Error
-	try_to_scan(String_View str, Rune rune)
-	{
-		ZoneScoped;
+void
+j_doc_close(J_Doc* doc)
+{
+	if (doc == nullptr)
+		return;
+
+	doc->~J_Doc();
+	::free(doc);
+}
 
-		if (auto [ok, err] = try_to_scan_character_in_string(str, rune); ok) return Error{};
-		else if (err) return err;
+const char*
+j_doc_error(const J_Doc* doc)
+{
+	return doc->err;
+}
 
-		if (auto [ok, err] = try_to_scan_escaped_character(str, rune); ok) return Error{};
-		else if (err) return err;
+static inline bool
+_j_cursor_fail(const J_Cursor& cursor, Error err)
+{
+	cursor.doc->err = err.err.data();
+	return false;
+}
 
-		if (auto [ok, err] = try_to_scan_escaped_unicode(str, rune); ok) return Error{};
-		else if (err) return err;
+J_Cursor
+j_doc_root(J_Doc* doc)
+{
+	Cursor_Reader reader{J_Cursor{doc, 0}};
+	return J_Cursor{doc, reader.next_offset()};
+}
 
-		if (auto [ok, err] = try_to_scan_null(str, rune); ok) return Error{};
-		else if (err) return err;
+J_JSON_KIND
+j_cursor_kind(J_Cursor cursor)
+{
+	switch (cursor.offset < cursor.doc->input.size() ? cursor.doc->input[cursor.offset] : '\0')
+	{
+	case 'n': return J_JSON_NULL;
+	case 't': case 'f': return J_JSON_BOOL;
+	case '"': return J_JSON_STRING;
+	case '[': return J_JSON_ARRAY;
+	case '{': return J_JSON_OBJECT;
+	default: return J_JSON_NUMBER; // or garbage, which the getters reject
+	}
+}
 
-		if (auto [ok, err] = try_to_scan_true(str, rune); ok) return Error{};
-		else if (err) return err;
+bool
+j_cursor_field(J_Cursor object, const char* key, J_Cursor* value)
+{
+	ZoneScoped;
 
-		if (auto [ok, err] = try_to_scan_false(str, rune); ok) return Error{};
-		else if (err) return err;
+	Cursor_Reader reader{object};
+	JSON_Token token{};
+	if (auto err = reader.next(token))
+		return _j_cursor_fail(object, err);
+	if (token.kind() != JSON_Token::T_lbrace)
+		return _j_cursor_fail(object, Error{"Not an object"});
 
-		if (auto [ok, err] = try_to_scan_number(str, rune); ok) return Error{};
-		else if (err) return err;
+	size_t key_size = ::strlen(key);
+	while (true)
+	{
+		if (auto err = reader.next(token))
+			return _j_cursor_fail(object, err);
+		if (token.kind() == JSON_Token::T_rbrace)
+			return false;
+		if (token.kind() != JSON_Token::T_string)
+			return _j_cursor_fail(object, Error{"Unexpected terminal"});
+		bool found = Cursor_Reader::key_equals(token.data(), key, key_size);
+
+		JSON_Token colon{};
+		if (auto err = reader.next(colon))
+			return _j_cursor_fail(object, err);
+		if (colon.kind() != JSON_Token::T_colon)
+			return _j_cursor_fail(object, Error{"Unexpected terminal"});
+
+		size_t offset = reader.next_offset();
+		if (found)
+		{
+			*value = J_Cursor{object.doc, offset};
+			return true;
+		}
 
-		if (auto [ok, err] = try_to_scan_singlechar_terminal(str, rune); ok) return Error{};
-		else if (err) return err;
+		if (auto err = reader.skip(offset))
+			return _j_cursor_fail(object, err);
 
-		return Error{"Invalid character"};
+		if (auto err = reader.next(token))
+			return _j_cursor_fail(object, err);
+		if (token.kind() != JSON_Token::T_comma && token.kind() != JSON_Token::T_rbrace)
+			return _j_cursor_fail(object, Error{"Unexpected terminal"});
+		if (token.kind() == JSON_Token::T_rbrace)
+			return false;
 	}
+}
 
-	inline Error
-	end_input()
+bool
+j_cursor_first(J_Cursor container, J_Cursor* child)
+{
+	Cursor_Reader reader{container};
+	JSON_Token token{};
+	if (auto err = reader.next(token))
+		return _j_cursor_fail(container, err);
+
+	if (token.kind() == JSON_Token::T_lbracket)
 	{
-		try_to_scan({}, JSON_Token::META_END_OF_INPUT);
-		_tokens.emplace_back(JSON_Token::META_END_OF_INPUT);
-		return Error{};
+		size_t offset = reader.next_offset();
+		if (reader.at(offset) == ']')
+			return false;
+
+		*child = J_Cursor{container.doc, offset};
+		return true;
 	}
 
-	Result<std::vector<JSON_Token>>
-	lex()
+	if (token.kind() == JSON_Token::T_lbrace)
 	{
-		ZoneScoped;
+		if (auto err = reader.next(token))
+			return _j_cursor_fail(container, err);
+		if (token.kind() == JSON_Token::T_rbrace)
+			return false;
+		if (token.kind() != JSON_Token::T_string)
+			return _j_cursor_fail(container, Error{"Unexpected terminal"});
 
-		const utf8proc_uint8_t* BASE = (const utf8proc_uint8_t*)_string.data();
-		const utf8proc_ssize_t SIZE = _string.size();
+		if (auto err = reader.next(token))
+			return _j_cursor_fail(container, err);
+		if (token.kind() != JSON_Token::T_colon)
+			return _j_cursor_fail(container, Error{"Unexpected terminal"});
 
-		const utf8proc_uint8_t* it = BASE;
-		while (it < BASE + SIZE)
-		{
-			FrameMark;
+		*child = J_Cursor{container.doc, reader.next_offset()};
+		return true;
+	}
 
-			Rune rune{};
-			
-			auto rune_size = utf8proc_iterate(it, SIZE - (it - BASE), &rune); 
-			if (rune_size < 0)
-				return Error{utf8proc_errmsg(rune_size)};
+	return _j_cursor_fail(container, Error{"Not a container"});
+}
 
-			if (auto parse_err = try_to_scan({(char*)it, (size_t)rune_size}, rune))
-				return parse_err;
+bool
+j_cursor_next(J_Cursor* cursor)
+{
+	ZoneScoped;
 
-			it += rune_size;
-		}
+	Cursor_Reader reader{*cursor};
+	if (auto err = reader.skip(reader.next_offset()))
+		return _j_cursor_fail(*cursor, err);
 
-		end_input();
-		return std::move(_tokens);
+	JSON_Token token{};
+	if (auto err = reader.next(token))
+		return _j_cursor_fail(*cursor, err);
+	if (token.kind() == JSON_Token::T_rbracket || token.kind() == JSON_Token::T_rbrace)
+		return false;
+	if (token.kind() != JSON_Token::T_comma)
+		return _j_cursor_fail(*cursor, Error{"Unexpected terminal"});
+
+	// In objects the next value comes after a key and a colon, an array's string elements are
+	// never followed by a colon
+	size_t offset = reader.next_offset();
+	if (reader.at(offset) == '"')
+	{
+		if (auto err = reader.token(offset, token))
+			return _j_cursor_fail(*cursor, err);
+
+		size_t after = reader.next_offset();
+		if (reader.at(after) == ':')
+			offset = reader.next_offset();
 	}
-};
 
-#pragma section("API")
+	cursor->offset = offset;
+	return true;
+}
 
-J_Version
-j_version()
+bool
+j_cursor_get_number(J_Cursor cursor, J_Number* number)
 {
-	return {0, 1, 0};
+	Cursor_Reader reader{cursor};
+	JSON_Token token{};
+	if (auto err = reader.next(token))
+		return _j_cursor_fail(cursor, err);
+	if (token.kind() != JSON_Token::T_number)
+		return _j_cursor_fail(cursor, Error{"Not a number"});
+
+	*number = Number::parse(token.data()).to_double();
+	return true;
 }
 
-J_Parse_Result
-j_parse(const char* json_string)
+bool
+j_cursor_get_bool(J_Cursor cursor, J_Bool* value)
 {
-	ZoneScoped;
-
-	auto table = JSON_PTable();
-
-	auto [tokens, lex_err] = Lexer(json_string).lex();
-	if (lex_err)
-		return {J_JSON{}, lex_err.err.data()};
-
-	auto [json, parse_err] = Parser(tokens).parse();
-	if (parse_err)
-		return {J_JSON{}, parse_err.err.data()};
+	Cursor_Reader reader{cursor};
+	JSON_Token token{};
+	if (auto err = reader.next(token))
+		return _j_cursor_fail(cursor, err);
+	if (token.kind() != JSON_Token::T_true && token.kind() != JSON_Token::T_false)
+		return _j_cursor_fail(cursor, Error{"Not a bool"});
+
+	*value = token.kind() == JSON_Token::T_true;
+	return true;
+}
 
-	return {json};
+bool
+j_cursor_get_string(J_Cursor cursor, J_String* string)
+{
+	Cursor_Reader reader{cursor};
+	JSON_Token token{};
+	if (auto err = reader.next(token))
+		return _j_cursor_fail(cursor, err);
+	if (token.kind() != JSON_Token::T_string)
+		return _j_cursor_fail(cursor, Error{"Not a string"});
+
+	*string = cursor.doc->strings.decode(token.data());
+	return true;
 }
 
 void
@@ -951,7 +4910,7 @@ j_free(J_JSON json)
 		return;
 
 	case J_JSON_STRING:
-		return ::free((void*)json.as_string);
+		return String_Arena::release(json.as_string);
 
 	case J_JSON_ARRAY:
 		for (auto it = json.as_array.ptr; it != json.as_array.ptr + json.as_array.count; it++)
@@ -963,11 +4922,11 @@ j_free(J_JSON json)
 
 		for (auto it = json.as_object.pairs; it != json.as_object.pairs + json.as_object.count; it++)
 		{
-			::free((void*)it->key);
+			String_Arena::release(it->key);
 			j_free(it->value);
 		}
 
-		return ::free((void*)json.as_object.pairs);
+		return _j_free_pairs(json.as_object);
 
 	default:
 		unreachable("invalid kind");
@@ -993,24 +4952,66 @@ _j_dump(J_JSON json, char* dump)
 		return size;
 
 	case J_JSON_NUMBER:
+		if (json.flags & J_JSON_FLAG_NUMBER_TEXT)
+		{
+			size += json.as_number_text.count;
+			if (dump)
+				::memcpy((void*)dump, json.as_number_text.ptr, size);
+			return size;
+		}
+
 		size += ::snprintf(nullptr, 0, "%.16lg", json.as_number);
 		if (dump)
 			::snprintf(dump, size + 1, "%.16lg", json.as_number);
 		return size;
 
-	case J_JSON_STRING:
+	case J_JSON_STRING: {
 		size += 1;
 		if (dump)
 			dump[0] = '"';
 
-		size += ::strlen(json.as_string);
-		if (dump)
-			::memcpy((void*)&dump[1], json.as_string, size - 1);
+		// Escape what JSON requires to be escaped, copy everything else as is
+		constexpr char HEX[] = "0123456789abcdef";
+		const char* string = json.as_string;
+		size_t count = String_Arena::header(string)->count;
+		for (size_t i = 0; i < count; i++)
+		{
+			char escaped[6] = {'\\'};
+			size_t escaped_size = 2;
+			switch (uint8_t c = string[i])
+			{
+			case '"':  escaped[1] = '"'; break;
+			case '\\': escaped[1] = '\\'; break;
+			case '\b': escaped[1] = 'b'; break;
+			case '\f': escaped[1] = 'f'; break;
+			case '\n': escaped[1] = 'n'; break;
+			case '\r': escaped[1] = 'r'; break;
+			case '\t': escaped[1] = 't'; break;
+			default:
+				if (c >= 0x20)
+				{
+					size += 1;
+					if (dump)
+						dump[size - 1] = char(c);
+					continue;
+				}
+				::memcpy(escaped + 1, "u00", 3);
+				escaped[4] = HEX[c >> 4];
+				escaped[5] = HEX[c & 0xF];
+				escaped_size = 6;
+				break;
+			}
+
+			if (dump)
+				::memcpy((void*)&dump[size], escaped, escaped_size);
+			size += escaped_size;
+		}
 
 		size += 1;
 		if (dump)
 			dump[size - 1] = '"';
 		return size;
+	}
 
 	case J_JSON_ARRAY:
 		size += 1;
@@ -1075,12 +5076,18 @@ j_dump(J_JSON json)
 	// Find how much memory we need
 	size_t size = _j_dump(json, nullptr);
 
-	char* dump = (char*)::malloc(size + 1);
+	char* dump = (char*)j_malloc(size + 1);
 	_j_dump(json, dump);
 	dump[size] = '\0';
 	return dump;
 }
 
+size_t
+j_allocation_count()
+{
+	return ALLOCATION_COUNT;
+}
+
 J_Bool
 j_get_J_Bool(J_JSON json)
 {
@@ -1092,9 +5099,36 @@ J_Number
 j_get_J_Number(J_JSON json)
 {
 	assert(json.kind == J_JSON_NUMBER);
+	if (json.flags & J_JSON_FLAG_NUMBER_TEXT)
+		return Number::parse(String_View{json.as_number_text.ptr, json.as_number_text.count}).to_double();
 	return json.as_number;
 }
 
+bool
+j_get_number_int64(J_JSON json, int64_t* value)
+{
+	assert(json.kind == J_JSON_NUMBER);
+	if (json.flags & J_JSON_FLAG_NUMBER_TEXT)
+		return Number::parse(String_View{json.as_number_text.ptr, json.as_number_text.count}).to_int64(*value);
+
+	// [-2^63, 2^63), both bounds are exact doubles
+	double number = json.as_number;
+	if (number != ::trunc(number) || number < -0x1p63 || number >= 0x1p63)
+		return false;
+	*value = int64_t(number);
+	return true;
+}
+
+const char*
+j_get_number_text(J_JSON json, size_t* count)
+{
+	assert(json.kind == J_JSON_NUMBER);
+	if ((json.flags & J_JSON_FLAG_NUMBER_TEXT) == 0)
+		return nullptr;
+	*count = json.as_number_text.count;
+	return json.as_number_text.ptr;
+}
+
 J_String
 j_get_J_String(J_JSON json)
 {
@@ -1102,6 +5136,12 @@ j_get_J_String(J_JSON json)
 	return json.as_string;
 }
 
+size_t
+j_string_length(J_String string)
+{
+	return String_Arena::header(string)->count;
+}
+
 J_Array
 j_get_J_Array(J_JSON json)
 {
@@ -1115,47 +5155,3 @@ j_get_J_Object(J_JSON json)
 	assert(json.kind == J_JSON_OBJECT);
 	return json.as_object;
 }
-
-void
-JSON_Token::fill_ptable(PTable& ptable)
-{
-	ptable.add(META_START, T_null, {N_V});
-	ptable.add(META_START, T_true, {N_V});
-	ptable.add(META_START, T_false, {N_V});
-	ptable.add(META_START, T_number, {N_V});
-	ptable.add(META_START, T_string, {N_V});
-	ptable.add(META_START, T_lbracket, {N_V});
-	ptable.add(META_START, T_lbrace, {N_V});
-
-	ptable.add(N_V, T_null, {T_null});
-	ptable.add(N_V, T_true, {T_true});
-	ptable.add(N_V, T_false, {T_false});
-	ptable.add(N_V, T_number, {T_number});
-	ptable.add(N_V, T_string, {T_string});
-	ptable.add(N_V, T_lbracket, {N_ARRAY});
-	ptable.add(N_V, T_lbrace, {N_OBJECT});
-
-	// Object
-	ptable.add(N_OBJECT, T_lbrace, {T_lbrace, N_MEMBERS, T_rbrace});
-
-	ptable.add(N_MEMBERS, T_string, {T_string, T_colon, N_V, N_MORE_MEMBERS});
-	ptable.add(N_MEMBERS, T_rbrace, {META_EPS});
-
-	ptable.add(N_MORE_MEMBERS, T_rbrace, {META_EPS});
-	ptable.add(N_MORE_MEMBERS, T_comma, {T_comma, T_string, T_colon, N_V, N_MORE_MEMBERS});
-
-	// Array
-	ptable.add(N_ARRAY, T_lbracket, {T_lbracket, N_ELEMENTS, T_rbracket});
-
-	ptable.add(N_ELEMENTS, T_lbracket, {N_V, N_MORE_ELEMENTS});
-	ptable.add(N_ELEMENTS, T_lbrace, {N_V, N_MORE_ELEMENTS});
-	ptable.add(N_ELEMENTS, T_string, {N_V, N_MORE_ELEMENTS});
-	ptable.add(N_ELEMENTS, T_number, {N_V, N_MORE_ELEMENTS});
-	ptable.add(N_ELEMENTS, T_true, {N_V, N_MORE_ELEMENTS});
-	ptable.add(N_ELEMENTS, T_false, {N_V, N_MORE_ELEMENTS});
-	ptable.add(N_ELEMENTS, T_null, {N_V, N_MORE_ELEMENTS});
-	ptable.add(N_ELEMENTS, T_rbracket, {META_EPS});
-
-	ptable.add(N_MORE_ELEMENTS, T_rbracket, {META_EPS});
-	ptable.add(N_MORE_ELEMENTS, T_comma, {T_comma, N_V, N_MORE_ELEMENTS});
-}